@@ -0,0 +1,901 @@
+// Microbenchmarks for the HTTP request path.
+//
+//   lanchat_bench [--json] [filter]
+//
+// Only benchmarks whose name contains `filter` are run. Each reports ns/op,
+// heap allocations/op and allocated bytes/op; --json prints one object per
+// line for scripts to compare runs. The "allocs" check serves keep-alive
+// requests from an in-process server and fails if the request path touches
+// the global heap, or if a request does not get the status its case expects.
+
+#include "http/http_parser.hpp"
+#include "http/http_router.hpp"
+#include "http/http_scan.hpp"
+#include "http/http_server.hpp"
+#include "util/json_encoder.hpp"
+#include "util/json_fields.hpp"
+#include "util/log.hpp"
+#include "util/metrics.hpp"
+#include "util/timer_wheel.hpp"
+#include "util/trace.hpp"
+#include "util/utils.hpp"
+#include "message/message_handler.hpp"
+#include <nlohmann/json.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <streambuf>
+#include <string>
+#include <memory>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Every global allocation in the process is counted, server threads included.
+// GCC flags the malloc/free pairing once library code is inlined here, but
+// both operators below agree on it.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+static std::atomic<uint64_t> gAllocations{0};
+static std::atomic<uint64_t> gAllocatedBytes{0};
+
+void* operator new(size_t size) {
+    gAllocations.fetch_add(1, std::memory_order_relaxed);
+    gAllocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+namespace {
+
+// Requests captured from the browsers and tools that talk to lanchat. Every
+// entry must parse completely; the benchmark aborts otherwise.
+struct CorpusEntry {
+    const char* name;
+    const char* method;
+    const char* path;
+    std::string raw;
+};
+
+std::vector<CorpusEntry> corpus() {
+    return {
+        {"curl_get", "GET", "/messages",
+         "GET /messages HTTP/1.1\r\nHost: localhost:8080\r\nUser-Agent: curl/7.88.1\r\nAccept: */*\r\n\r\n"},
+        {"chrome_poll", "GET", "/messages",
+         "GET /messages HTTP/1.1\r\n"
+         "Host: 192.168.1.23:8080\r\n"
+         "Connection: keep-alive\r\n"
+         "sec-ch-ua: \"Google Chrome\";v=\"119\", \"Chromium\";v=\"119\", \"Not?A_Brand\";v=\"24\"\r\n"
+         "sec-ch-ua-mobile: ?0\r\n"
+         "User-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) "
+         "Chrome/119.0.0.0 Safari/537.36\r\n"
+         "sec-ch-ua-platform: \"Windows\"\r\n"
+         "Accept: */*\r\n"
+         "Sec-Fetch-Site: same-origin\r\n"
+         "Sec-Fetch-Mode: cors\r\n"
+         "Sec-Fetch-Dest: empty\r\n"
+         "Referer: http://192.168.1.23:8080/\r\n"
+         "Accept-Encoding: gzip, deflate\r\n"
+         "Accept-Language: en-GB,en-US;q=0.9,en;q=0.8\r\n\r\n"},
+        {"firefox_post", "POST", "/messages",
+         "POST /messages HTTP/1.1\r\n"
+         "Host: localhost:8080\r\n"
+         "User-Agent: Mozilla/5.0 (X11; Ubuntu; Linux x86_64; rv:120.0) Gecko/20100101 Firefox/120.0\r\n"
+         "Accept: */*\r\n"
+         "Accept-Language: en-US,en;q=0.5\r\n"
+         "Accept-Encoding: gzip, deflate, br\r\n"
+         "Referer: http://localhost:8080/\r\n"
+         "Content-Type: application/json\r\n"
+         "Content-Length: 44\r\n"
+         "Origin: http://localhost:8080\r\n"
+         "Connection: keep-alive\r\n"
+         "Sec-Fetch-Dest: empty\r\n"
+         "Sec-Fetch-Mode: cors\r\n"
+         "Sec-Fetch-Site: same-origin\r\n\r\n"
+         "{\"user\":\"alice\",\"message\":\"lunch at 12:30?\"}"},
+        {"safari_index", "GET", "/",
+         "GET / HTTP/1.1\r\n"
+         "Host: lanchat.local:8080\r\n"
+         "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+         "Upgrade-Insecure-Requests: 1\r\n"
+         "User-Agent: Mozilla/5.0 (Macintosh; Intel Mac OS X 10_15_7) AppleWebKit/605.1.15 "
+         "(KHTML, like Gecko) Version/17.1 Safari/605.1.15\r\n"
+         "Accept-Language: en-US,en;q=0.9\r\n"
+         "Accept-Encoding: gzip, deflate\r\n"
+         "Connection: keep-alive\r\n\r\n"},
+        {"http10_peers", "GET", "/peers",
+         "GET /peers?fresh=1 HTTP/1.0\r\nHost: 10.0.0.7\r\n\r\n"},
+    };
+}
+
+bool gJson = false;  // --json: one JSON object per line instead of a table
+
+// Per-operation cost over the final, timed batch. Allocations count every
+// thread in the process, so in-process server benchmarks include the server.
+struct Measurement {
+    double ns = 0;
+    double allocs = 0;
+    double allocBytes = 0;
+};
+
+template <typename Fn>
+Measurement measure(Fn&& fn, size_t minIters = 1000) {
+    using Clock = std::chrono::steady_clock;
+    size_t iters = minIters;
+    while (true) {
+        uint64_t allocsBefore = gAllocations.load(std::memory_order_relaxed);
+        uint64_t bytesBefore = gAllocatedBytes.load(std::memory_order_relaxed);
+        auto start = Clock::now();
+        for (size_t i = 0; i < iters; ++i) fn();
+        double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+        if (ns > 2e8 || iters > (1u << 30)) {
+            Measurement m;
+            m.ns = ns / iters;
+            m.allocs = double(gAllocations.load(std::memory_order_relaxed) - allocsBefore) / iters;
+            m.allocBytes = double(gAllocatedBytes.load(std::memory_order_relaxed) - bytesBefore) / iters;
+            return m;
+        }
+        iters *= 2;
+    }
+}
+
+// bytes is the input processed per operation, for throughput; 0 omits it
+void report(const std::string& name, const Measurement& m, size_t bytes) {
+    if (gJson) {
+        std::printf("{\"name\":\"%s\",\"ns_per_op\":%.1f,\"allocs_per_op\":%.2f,\"bytes_per_op\":%.1f", name.c_str(),
+                    m.ns, m.allocs, m.allocBytes);
+        if (bytes) std::printf(",\"mb_per_s\":%.1f", bytes / m.ns * 1e3);
+        std::printf("}\n");
+        return;
+    }
+    std::printf("%-40s %12.1f ns/op %9.2f allocs/op %11.1f B/op", name.c_str(), m.ns, m.allocs, m.allocBytes);
+    if (bytes) std::printf(" %10.1f MB/s", bytes / m.ns * 1e3);
+    std::printf("\n");
+}
+
+// A single figure that is not a per-operation cost, such as a count
+void reportValue(const std::string& name, double value, const char* unit) {
+    if (gJson) {
+        std::printf("{\"name\":\"%s\",\"value\":%.2f,\"unit\":\"%s\"}\n", name.c_str(), value, unit);
+        return;
+    }
+    std::printf("%-40s %12.2f %s\n", name.c_str(), value, unit);
+}
+
+void validateCorpus(const std::vector<CorpusEntry>& entries) {
+    for (const auto& e : entries) {
+        // Feed every split point to exercise resumption across partial reads
+        for (size_t split = 0; split <= e.raw.size(); ++split) {
+            HttpParser parser;
+            parser.parse(std::string_view(e.raw).substr(0, split));
+            std::string copy = e.raw;
+            auto status = parser.parse(copy);
+            if (status == HttpParser::Status::HeadersComplete) status = parser.parse(copy);
+            const HttpRequest& req = parser.request();
+            if (status != HttpParser::Status::Complete || req.method != e.method || req.path != e.path ||
+                parser.consumed() != e.raw.size()) {
+                std::fprintf(stderr, "corpus entry %s failed to parse at split %zu\n", e.name, split);
+                std::exit(1);
+            }
+        }
+    }
+}
+
+void benchParse(const std::vector<CorpusEntry>& entries) {
+    for (auto isa : {HttpScan::Isa::Scalar, HttpScan::Isa::SSE2, HttpScan::Isa::AVX2}) {
+        HttpScan::forceIsa(isa);
+        if (HttpScan::activeIsa() != isa) continue;
+        for (const auto& e : entries) {
+            HttpParser parser;
+            Measurement m = measure([&] {
+                parser.reset();
+                auto status = parser.parse(e.raw);
+                if (status == HttpParser::Status::HeadersComplete) status = parser.parse(e.raw);
+                if (status != HttpParser::Status::Complete) std::abort();
+            });
+            report(std::string("parse/") + HttpScan::isaName(isa) + "/" + e.name, m, e.raw.size());
+        }
+    }
+}
+
+// A request with a large header block arriving in 1 KB reads: the previous
+// handleClient searched the whole accumulated buffer after every read
+void benchLargeHeaders() {
+    std::string raw = "GET /messages HTTP/1.1\r\nHost: localhost:8080\r\n";
+    while (raw.size() < 60 * 1024) raw += "Cookie: session=0123456789abcdef0123456789abcdef0123456789\r\n";
+    raw += "\r\n";
+    const size_t chunk = 1024;
+
+    Measurement rescan = measure([&] {
+        std::string buf;
+        for (size_t off = 0; off < raw.size(); off += chunk) {
+            buf.append(raw, off, chunk);
+            if (buf.find("\r\n\r\n") != std::string::npos) break;
+        }
+    }, 10);
+    report("chunked_60k/rescan_find", rescan, raw.size());
+
+    for (auto isa : {HttpScan::Isa::Scalar, HttpScan::Isa::SSE2, HttpScan::Isa::AVX2}) {
+        HttpScan::forceIsa(isa);
+        if (HttpScan::activeIsa() != isa) continue;
+        Measurement m = measure([&] {
+            std::string buf;
+            HttpParser parser;
+            for (size_t off = 0; off < raw.size(); off += chunk) {
+                buf.append(raw, off, chunk);
+                if (parser.parse(buf) != HttpParser::Status::Incomplete) break;
+            }
+        }, 10);
+        report(std::string("chunked_60k/parser/") + HttpScan::isaName(isa), m, raw.size());
+    }
+}
+
+// Chat-shaped messages: mostly short ASCII, some quotes, newlines and
+// multi-byte UTF-8, and the occasional long paste
+std::vector<Message> sampleMessages(size_t n) {
+    const char* texts[] = {
+        "lunch at 12:30?",
+        "sure, see you at the \"usual\" place",
+        "build is green again \xF0\x9F\x8E\x89",
+        "line one\nline two\n\tindented",
+        "C:\\Users\\alice\\Desktop\\notes.txt",
+    };
+    std::string paste(2000, 'x');
+    for (size_t i = 100; i < paste.size(); i += 250) paste[i] = '\n';
+    std::vector<Message> out;
+    for (size_t i = 0; i < n; ++i) {
+        Message m(i % 3 ? "alice" : "b\xC3\xB6rk", i % 50 == 49 ? paste : texts[i % 5]);
+        m.id = std::to_string(100000 + i);
+        m.timestamp = "2026-10-18 09:" + std::to_string(10 + i % 50) + ":00";
+        out.push_back(std::move(m));
+    }
+    return out;
+}
+
+nlohmann::json toJson(const std::vector<Message>& messages) {
+    nlohmann::json j = nlohmann::json::array();
+    for (const auto& m : messages) {
+        j.push_back({{"id", m.id}, {"user", m.user}, {"message", m.message}, {"timestamp", m.timestamp}});
+    }
+    return j;
+}
+
+nlohmann::json toJson(const std::vector<PeerInfo>& peers) {
+    nlohmann::json j = nlohmann::json::array();
+    for (const auto& p : peers) j.push_back({{"id", p.id}, {"address", p.address}});
+    return j;
+}
+
+// The encoder must match nlohmann's compact output byte for byte, for every
+// kernel; the benchmark aborts otherwise
+void validateJson(const std::vector<Message>& messages) {
+    std::vector<Message> edge;
+    for (size_t len = 0; len < 80; ++len) {
+        for (int c = 0; c < 0x80; c += 7) {
+            Message m;
+            m.message.assign(len, 'a');
+            m.message += static_cast<char>(c);
+            m.message.append(len % 37, 'b');
+            edge.push_back(std::move(m));
+        }
+    }
+    for (bool scalar : {true, false}) {
+        JsonEncoder::forceScalar(scalar);
+        for (const auto& list : {messages, edge}) {
+            std::string out;
+            JsonEncoder::appendArray(out, list);
+            if (out != toJson(list).dump()) {
+                std::fprintf(stderr, "json encoder (%s) differs from nlohmann\n", JsonEncoder::kernelName());
+                std::abort();
+            }
+        }
+    }
+}
+
+void benchJson() {
+    auto messages = sampleMessages(1000);
+    validateJson(messages);
+    std::vector<PeerInfo> peers;
+    for (int i = 0; i < 16; ++i) peers.push_back({"peer-" + std::to_string(i), "192.168.1." + std::to_string(10 + i), {}});
+    size_t messageBytes = toJson(messages).dump().size();
+    size_t peerBytes = toJson(peers).dump().size();
+
+    // What /messages, /peers and every save did before: a json tree, then dump(4)
+    report("json/messages_1000/nlohmann_dump4", measure([&] { toJson(messages).dump(4); }, 10), messageBytes);
+    report("json/messages_1000/nlohmann_dump", measure([&] { toJson(messages).dump(); }, 10), messageBytes);
+    report("json/peers_16/nlohmann_dump4", measure([&] { toJson(peers).dump(4); }), peerBytes);
+
+    std::string big(4096, 'x');
+    for (bool scalar : {true, false}) {
+        JsonEncoder::forceScalar(scalar);
+        std::string kernel = JsonEncoder::kernelName();
+        std::string out;
+        report("json/messages_1000/encoder/" + kernel, measure([&] {
+            out.clear();
+            JsonEncoder::appendArray(out, messages);
+        }, 10), messageBytes);
+        report("json/peers_16/encoder/" + kernel, measure([&] {
+            out.clear();
+            JsonEncoder::appendArray(out, peers);
+        }), peerBytes);
+        volatile size_t sink = 0;
+        report("json/find_escape_4k/" + kernel, measure([&] { sink = JsonEncoder::findEscape(big.data(), big.size()); }), big.size());
+        (void)sink;
+    }
+    JsonEncoder::forceScalar(false);
+
+    // POST /messages bodies: a typical one and one that needs unescaping
+    struct PostBody {
+        const char* name;
+        std::string body;
+    };
+    std::vector<PostBody> bodies = {
+        {"plain", "{\"user\":\"alice\",\"message\":\"lunch at 12:30?\"}"},
+        {"escaped", "{\"user\":\"b\\u00f6rk\",\"message\":\"line one\\nline \\\"two\\\" \\ud83c\\udf89\"}"},
+    };
+    for (const auto& b : bodies) {
+        report(std::string("json/post_") + b.name + "/nlohmann", measure([&] {
+            auto parsed = nlohmann::json::parse(b.body);
+            std::string user = parsed.value("user", "anonymous");
+            std::string message = parsed.value("message", "");
+            if (message.empty()) std::abort();
+        }), b.body.size());
+        JsonFields fields{"user", "message"};
+        report(std::string("json/post_") + b.name + "/fields", measure([&] {
+            std::string_view user = "anonymous";
+            std::string_view message;
+            if (!fields.parse(b.body) || !fields.get("user", user) || !fields.get("message", message)) std::abort();
+            if (message.empty()) std::abort();
+        }), b.body.size());
+    }
+}
+
+// What HttpServer::buildResponse does for a short text reply, in a request arena
+void benchResponse() {
+    RequestArena arena;
+    report("response/build_text", measure([&] {
+        {
+            RequestArena::Scope scope(arena);
+            HttpResponse res;
+            res.code = 404;
+            res.contentType = "text/plain";
+            res.setBody("Not Found");
+        }
+        arena.reset();
+    }), 0);
+    std::string page(16 * 1024, 'x');
+    report("response/build_16k", measure([&] {
+        {
+            RequestArena::Scope scope(arena);
+            HttpResponse res;
+            res.contentType = "text/html";
+            res.setBody(page);
+        }
+        arena.reset();
+    }), page.size());
+}
+
+// MessageHandler with a history of `size` messages, saved to a scratch file
+// on every write as in the server
+void benchMessages() {
+    auto path = std::filesystem::temp_directory_path() / "lanchat_bench_store.json";
+    for (size_t size : {100, 1000, 10000}) {
+        std::filesystem::remove(path);
+        std::string suffix = "/history_" + std::to_string(size);
+        {
+            MessageHandler handler(path.string());
+            handler.addMessages(sampleMessages(size));
+            report("messages/get_all_messages" + suffix, measure([&] {
+                if (handler.getAllMessages().size() != size) std::abort();
+            }, 10), 0);
+            report("messages/snapshot" + suffix, measure([&] {
+                if (handler.snapshot()->size() != size) std::abort();
+            }), 0);
+            // Last, since every operation grows the history by one (by a few
+            // hundred over the run for the smaller sizes)
+            report("messages/add_message" + suffix, measure([&] {
+                handler.addMessage("alice", "lunch at 12:30?");
+            }, 1), 0);
+        }
+        std::filesystem::remove(path);
+    }
+}
+
+void benchUtils() {
+    std::string csv = "alice,192.168.1.23,8080,online,2026-10-18 09:30:00,lanchat/1.0";
+    report("utils/split_6_fields", measure([&] {
+        if (Utils::split(csv, ',').size() != 6) std::abort();
+    }), csv.size());
+    std::string padded = "  \t lunch at 12:30?  \r\n";
+    report("utils/trim", measure([&] {
+        if (Utils::trim(padded).size() != 15) std::abort();
+    }), padded.size());
+    report("utils/current_time_string", measure([&] {
+        if (Utils::getCurrentTimeString().size() != 19) std::abort();
+    }), 0);
+}
+
+// Minimal blocking HTTP client that reads into static storage so it does not
+// allocate itself. Returns the status code, or -1 on failure.
+int roundTrip(SOCKET s, const std::string& request) {
+    static char buf[256 * 1024];
+    if (::send(s, request.data(), static_cast<int>(request.size()), 0) != static_cast<int>(request.size())) return -1;
+    size_t have = 0;
+    size_t total = 0;
+    while (total == 0 || have < total) {
+        int n = ::recv(s, buf + have, static_cast<int>(sizeof(buf) - have), 0);
+        if (n <= 0) return -1;
+        have += n;
+        if (total == 0) {
+            std::string_view head(buf, have);
+            size_t end = head.find("\r\n\r\n");
+            if (end == std::string_view::npos) continue;
+            size_t cl = head.substr(0, end).find("Content-Length: ");
+            total = end + 4 + (cl != std::string_view::npos ? std::strtoul(buf + cl + 16, nullptr, 10) : 0);
+        }
+    }
+    return std::atoi(buf + 9);
+}
+
+// Stops the run with a message rather than a bare abort, e.g. when web/ is missing
+void expectStatus(int status, int expected, const char* what) {
+    if (status == expected) return;
+    std::fprintf(stderr, "%s: got status %d, expected %d\n", what, status, expected);
+    std::exit(1);
+}
+
+SOCKET connectLoopback(int port) {
+    SOCKET s = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    if (s != INVALID_SOCKET && connect(s, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0) return s;
+    if (s != INVALID_SOCKET) CLOSE_SOCKET(s);
+    return INVALID_SOCKET;
+}
+
+// In-process server on a scratch message store, with one keep-alive client
+// connection. Peer discovery is not started, so there is no background traffic.
+class LocalServer {
+public:
+    LocalServer(IoMode mode, int port) : messages(store.path.string()) {
+#ifdef LANCHAT_SOURCE_DIR
+        // Static files are looked up relative to the working directory
+        std::error_code ec;
+        if (!std::filesystem::exists("web/app.js", ec)) std::filesystem::current_path(LANCHAT_SOURCE_DIR, ec);
+#endif
+        HttpServerConfig config;
+        config.ioMode = mode;
+        config.workerThreads = 1;
+        config.maxRequestsPerConnection = 1000000;
+        server = std::make_unique<HttpServer>(port, messages, peers, config);
+        server->start();
+        for (int attempt = 0; attempt < 50 && client == INVALID_SOCKET; ++attempt) {
+            client = connectLoopback(port);
+            if (client == INVALID_SOCKET) std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+    }
+
+    ~LocalServer() {
+        if (client != INVALID_SOCKET) CLOSE_SOCKET(client);
+        server->stop();
+    }
+
+    SOCKET client = INVALID_SOCKET;
+
+private:
+    struct Store {
+        std::filesystem::path path = std::filesystem::temp_directory_path() / "lanchat_bench_messages.json";
+        ~Store() { std::filesystem::remove(path); }  // Runs after MessageHandler's final save
+    } store;
+    MessageHandler messages;
+    PeerDiscovery peers;
+    std::unique_ptr<HttpServer> server;
+};
+
+struct AllocCase {
+    const char* name;
+    std::string request;
+    int status;  // Expected, so a case cannot pass by measuring some other path
+    bool mustBeZero;
+};
+
+bool checkAllocations(IoMode mode, const char* modeName, int port) {
+    bool ok = true;
+    // Debug logging stays on: formatting into the log ring is part of the request path
+    Log::setOutput(nullptr, nullptr);
+    {
+        LocalServer local(mode, port);
+        SOCKET client = local.client;
+        bool connected = client != INVALID_SOCKET;
+        std::vector<AllocCase> cases = {
+            {"static_app_js", "GET /app.js HTTP/1.1\r\nHost: localhost\r\n\r\n", 200, true},
+            {"not_found", corpus()[1].raw.replace(4, 9, "/missing"), 404, true},
+            {"method_not_allowed", "DELETE /messages HTTP/1.1\r\nHost: localhost\r\n\r\n", 405, true},
+            {"get_message_missing", "GET /messages/none HTTP/1.1\r\nHost: localhost\r\n\r\n", 404, true},
+            {"get_messages", corpus()[0].raw, 200, true},
+        };
+        for (const auto& c : cases) {
+            if (!connected) break;
+            for (int i = 0; i < 50; ++i) roundTrip(client, c.request);  // Warm the pools
+            const int iters = 1000;
+            uint64_t before = gAllocations.load();
+            int status = 0;
+            for (int i = 0; i < iters && status >= 0; ++i) status = roundTrip(client, c.request);
+            double perOp = double(gAllocations.load() - before) / iters;
+            std::string name = std::string("allocs/") + modeName + "/" + c.name;
+            reportValue(name, perOp, "allocs/op");
+            if (status < 0) {
+                std::fprintf(stderr, "%s: request failed\n", name.c_str());
+            } else if (status != c.status) {
+                std::fprintf(stderr, "%s: got status %d, expected %d\n", name.c_str(), status, c.status);
+            }
+            if (status != c.status || (c.mustBeZero && perOp > 0)) ok = false;
+        }
+        if (!connected) {
+            std::fprintf(stderr, "could not connect to the %s server on port %d\n", modeName, port);
+            ok = false;
+        }
+    }
+    Log::flush();
+    Log::setOutput(stdout, stderr);
+    return ok;
+}
+
+#ifdef _WIN32
+const char* kNullDevice = "NUL";
+#else
+const char* kNullDevice = "/dev/null";
+#endif
+
+// What a request cost in logging before: a few std::cout lines, each flushed
+// with std::endl, against one structured record handed to the log writer
+void benchLogging() {
+    std::string_view method = "GET";
+    std::string_view path = "/messages";
+    std::ofstream devnull(kNullDevice);
+    report("log/ostream_endl_x3", measure([&] {
+        devnull << "[DEBUG] Handling new client connection" << std::endl;
+        devnull << "[DEBUG] Request: " << method << " " << path << std::endl;
+        devnull << "[DEBUG] Handling GET for path: " << path << std::endl;
+    }), 0);
+
+    FILE* sink = std::fopen(kNullDevice, "w");
+    Log::setOutput(sink, sink);
+    uint64_t droppedBefore = Log::dropped();
+    uint64_t rid = 0;
+    report("log/structured_record", measure([&] {
+        LOG_DEBUG("request", {"rid", ++rid}, {"method", method}, {"path", path}, {"status", 200}, {"bytes", 1234u},
+                  {"us", 87});
+    }), 0);
+    Log::flush();
+    reportValue("log/structured_record_dropped", static_cast<double>(Log::dropped() - droppedBefore), "records");
+
+    // Whole requests over loopback, with debug logging on and off
+    {
+        LocalServer local(IoMode::Threaded, 18474);
+        std::string request = "GET /app.js HTTP/1.1\r\nHost: localhost\r\n\r\n";
+        for (auto level : {Log::Level::Off, Log::Level::Debug, Log::Level::Off, Log::Level::Debug}) {
+            Log::setLevel(level);
+            Measurement m = measure([&] {
+                expectStatus(roundTrip(local.client, request), 200, "log/request_app_js");
+            });
+            report(std::string("log/request_app_js/") + (level == Log::Level::Off ? "off" : "debug"), m, 0);
+        }
+    }
+    Log::flush();
+    Log::setOutput(stdout, stderr);
+    std::fclose(sink);
+}
+
+}  // namespace
+
+// Every value must land in the bucket whose bounds enclose it
+void validateHistogram() {
+    uint64_t x = 88172645463325252ull;
+    for (int i = 0; i < 1000000; ++i) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        uint64_t v = i < 4096 ? static_cast<uint64_t>(i) : x >> (x % 40 + 23);
+        size_t b = Metrics::Histogram::bucketOf(v);
+        bool inside = b == Metrics::Histogram::kBuckets - 1 ? v > Metrics::Histogram::upperBound(b - 1)
+                                                             : v <= Metrics::Histogram::upperBound(b) &&
+                                                                   (b == 0 || v > Metrics::Histogram::upperBound(b - 1));
+        if (!inside) {
+            std::fprintf(stderr, "histogram bucket mismatch for %llu\n", static_cast<unsigned long long>(v));
+            std::abort();
+        }
+    }
+}
+
+void benchMetrics() {
+    validateHistogram();
+    Metrics::Counter counter;
+    std::atomic<uint64_t> shared{0};
+    report("metrics/atomic_fetch_add", measure([&] { shared.fetch_add(1, std::memory_order_relaxed); }), 0);
+    report("metrics/sharded_counter_add", measure([&] { counter.add(0); }), 0);
+    Metrics::Histogram histogram;
+    uint64_t v = 0;
+    report("metrics/histogram_record", measure([&] { histogram.record(v += 977); }), 0);
+    report("metrics/histogram_record_since", measure([&] {
+        histogram.recordSince(std::chrono::steady_clock::now());
+    }), 0);
+
+    // A full scrape, including peers and the message history counters
+    Log::setOutput(nullptr, nullptr);
+    {
+        LocalServer local(IoMode::Threaded, 18475);
+        std::string request = "GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n";
+        report("metrics/scrape", measure([&] {
+            expectStatus(roundTrip(local.client, request), 200, "metrics/scrape");
+        }, 100), 0);
+    }
+    Log::flush();
+    Log::setOutput(stdout, stderr);
+}
+
+// Timers spread over every level of the wheel must each fire once, never
+// early and at most one tick plus one advance step late, and cancelled or
+// re-armed ones must not fire at their old deadline
+void validateTimerWheel() {
+    using Clock = TimerWheel::Clock;
+    const auto tick = std::chrono::milliseconds(10);
+    const Clock::time_point start{};
+    TimerWheel wheel(tick, start);
+    std::mt19937_64 rng(7);
+    const size_t n = 20000;
+    auto timers = std::make_unique<TimerWheel::Timer[]>(n);
+    std::vector<int> fired(n, 0);
+    std::vector<bool> cancelled(n, false);
+    Clock::time_point last = start;
+    for (size_t i = 0; i < n; ++i) {
+        timers[i].data = i;
+        // Up to about 12 hours, past level 2
+        wheel.schedule(timers[i], start + std::chrono::milliseconds(rng() % (1ull << (rng() % 26))));
+        last = std::max(last, timers[i].deadline());
+    }
+    for (size_t i = 0; i < n; i += 7) {
+        wheel.cancel(timers[i]);
+        cancelled[i] = true;
+    }
+    for (size_t i = 3; i < n; i += 11) {
+        wheel.schedule(timers[i], start + std::chrono::milliseconds(rng() % 100000));
+        cancelled[i] = false;
+        last = std::max(last, timers[i].deadline());
+    }
+    Clock::time_point now = start;
+    auto maxStep = std::chrono::milliseconds(1);
+    while (now <= last + tick) {
+        auto step = std::chrono::milliseconds(1 + rng() % 5000);
+        maxStep = std::max(maxStep, step);
+        now += step;
+        wheel.advance(now, [&](TimerWheel::Timer& timer) {
+            size_t i = timer.data;
+            if (timer.armed() || cancelled[i] || now < timer.deadline() || now - timer.deadline() > tick + step) {
+                std::fprintf(stderr, "timer %zu fired wrongly\n", i);
+                std::abort();
+            }
+            ++fired[i];
+        });
+    }
+    for (size_t i = 0; i < n; ++i) {
+        if (fired[i] != (cancelled[i] ? 0 : 1) || wheel.size() != 0) {
+            std::fprintf(stderr, "timer %zu fired %d times\n", i, fired[i]);
+            std::abort();
+        }
+    }
+}
+
+// Keeping tens of thousands of connection deadlines: arming, re-arming and
+// expiring them in the wheel, against one pass over every connection as a
+// periodic sweep makes
+void benchTimers() {
+    validateTimerWheel();
+    using Clock = TimerWheel::Clock;
+    const size_t pending = 50000;
+    const auto timeout = std::chrono::seconds(5);
+    Clock::time_point now{};
+    TimerWheel wheel(std::chrono::milliseconds(100), now);
+    auto timers = std::make_unique<TimerWheel::Timer[]>(pending);
+    for (size_t i = 0; i < pending; ++i) {
+        wheel.schedule(timers[i], now + timeout + std::chrono::milliseconds(i % 5000));
+    }
+    TimerWheel::Timer extra;
+    report("timers/arm_cancel_50k", measure([&] {
+        wheel.schedule(extra, now + timeout);
+        wheel.cancel(extra);
+    }), 0);
+    size_t next = 0;
+    report("timers/rearm_50k", measure([&] {
+        TimerWheel::Timer& timer = timers[next];
+        next = next + 1 == pending ? 0 : next + 1;
+        wheel.schedule(timer, timer.deadline() + std::chrono::milliseconds(1));
+    }), 0);
+    // Each expiry re-arms, as a connection that stays busy would, so the
+    // population stays at 50k while about 1% fire per tick
+    size_t expired = 0;
+    report("timers/advance_tick_50k", measure([&] {
+        now += wheel.tick();
+        wheel.advance(now, [&](TimerWheel::Timer& timer) {
+            ++expired;
+            wheel.schedule(timer, now + timeout);
+        });
+    }), 0);
+    if (expired == 0 || wheel.size() != pending) std::abort();
+
+    struct Entry {
+        Clock::time_point lastActivity;
+        bool busy = false;
+    };
+    std::unordered_map<int, Entry> conns;
+    for (size_t i = 0; i < pending; ++i) conns[static_cast<int>(i)].lastActivity = now;
+    size_t stale = 0;
+    report("timers/sweep_map_50k", measure([&] {
+        for (const auto& [fd, conn] : conns) {
+            if (!conn.busy && now - conn.lastActivity > timeout) ++stale;
+        }
+    }, 10), 0);
+    if (stale != 0) std::abort();
+}
+
+// Every route answers its own methods, 405s the others with the right Allow,
+// and paths next to a route are 404s
+void validateRouter() {
+    using Method = HttpMetrics::Method;
+    using Endpoint = HttpRouter::Endpoint;
+    struct Case {
+        Method method;
+        const char* path;
+        Endpoint endpoint;
+        int code;
+        const char* allow;
+        const char* param;
+    };
+    const Case cases[] = {
+        {Method::Get, "/", Endpoint::Index, 200, "", ""},
+        {Method::Get, "/index.html", Endpoint::Index, 200, "", ""},
+        {Method::Get, "/messages", Endpoint::ListMessages, 200, "", ""},
+        {Method::Post, "/messages", Endpoint::PostMessage, 200, "", ""},
+        {Method::Other, "/messages", Endpoint::None, 405, "GET, POST", ""},
+        {Method::Get, "/messages/42-abc", Endpoint::GetMessage, 200, "", "42-abc"},
+        {Method::Post, "/messages/42", Endpoint::None, 405, "GET", ""},
+        {Method::Post, "/messages/import", Endpoint::ImportMessages, 200, "", ""},
+        {Method::Get, "/messages/import", Endpoint::None, 405, "POST", ""},
+        {Method::Get, "/messages/", Endpoint::None, 404, "", ""},
+        {Method::Get, "/messages/42/x", Endpoint::None, 404, "", ""},
+        {Method::Get, "/clear", Endpoint::None, 405, "POST", ""},
+        {Method::Post, "/peers", Endpoint::None, 405, "GET", ""},
+        {Method::Get, "/debug/traces", Endpoint::Traces, 200, "", ""},
+        {Method::Other, "/missing", Endpoint::None, 404, "", ""},
+        {Method::Get, "/Messages", Endpoint::None, 404, "", ""},
+    };
+    for (const Case& c : cases) {
+        auto m = HttpRouter::match(c.method, c.path);
+        int code = m.endpoint != Endpoint::None ? 200 : m.allowed ? 405 : 404;
+        std::string_view allow = code == 405 ? HttpRouter::allowHeader(m.allowed) : "";
+        if (m.endpoint != c.endpoint || code != c.code || allow != c.allow || m.param != c.param) {
+            std::fprintf(stderr, "route %s misrouted\n", c.path);
+            std::abort();
+        }
+    }
+    if (HttpMetrics::routeOf("/messages/:id") != HttpMetrics::Route::Message) std::abort();
+}
+
+// Dispatching a request line to its endpoint: the route table against the
+// string comparisons it replaced
+void benchRouter() {
+    validateRouter();
+    using Method = HttpMetrics::Method;
+    struct Case {
+        const char* name;
+        Method method;
+        std::string path;
+    };
+    const Case cases[] = {
+        {"first", Method::Get, "/"},
+        {"last", Method::Get, "/debug/traces"},
+        {"param", Method::Get, "/messages/1712345678901-42"},
+        {"not_found", Method::Get, "/missing/page"},
+        {"method_not_allowed", Method::Post, "/peers"},
+    };
+    size_t hits = 0;
+    for (const Case& c : cases) {
+        report("router/" + std::string(c.name), measure([&] {
+            hits += static_cast<size_t>(HttpRouter::match(c.method, c.path).endpoint);
+        }), 0);
+    }
+    for (const Case& c : cases) {
+        report("router/chain_" + std::string(c.name), measure([&] {
+            std::string_view p = c.path;
+            if (c.method == Method::Get) {
+                if (p == "/" || p == "/index.html") ++hits;
+                else if (p == "/style.css") ++hits;
+                else if (p == "/app.js") ++hits;
+                else if (p == "/favicon.ico") ++hits;
+                else if (p == "/messages") ++hits;
+                else if (p == "/peers") ++hits;
+                else if (p == "/metrics") ++hits;
+                else if (p == "/debug/traces") ++hits;
+            } else if (c.method == Method::Post) {
+                if (p == "/messages") ++hits;
+                else if (p == "/messages/import") ++hits;
+                else if (p == "/clear") ++hits;
+            }
+        }), 0);
+    }
+    if (hits == 0) std::abort();
+}
+
+void benchTracing() {
+    auto start = Trace::Clock::now();
+    report("trace/record", measure([&] { Trace::record("bench", start, start, 1); }), 0);
+    report("trace/span", measure([&] { Trace::Span span("bench"); }), 0);
+    report("trace/collect", measure([&] { Trace::collect(); }, 10), 0);
+
+    // Whole requests over loopback, with tracing on and off
+    Log::setOutput(nullptr, nullptr);
+    {
+        LocalServer local(IoMode::Threaded, 18476);
+        std::string request = "GET /app.js HTTP/1.1\r\nHost: localhost\r\n\r\n";
+        for (bool on : {false, true, false, true}) {
+            Trace::setEnabled(on);
+            Measurement m = measure([&] {
+                expectStatus(roundTrip(local.client, request), 200, "trace/request_app_js");
+            });
+            report(std::string("trace/request_app_js/") + (on ? "on" : "off"), m, 0);
+        }
+    }
+    Log::flush();
+    Log::setOutput(stdout, stderr);
+}
+
+int main(int argc, char* argv[]) {
+    std::string filter;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--json") == 0) gJson = true;
+        else filter = argv[i];
+    }
+    auto selected = [&filter](const char* name) { return filter.empty() || std::string(name).find(filter) != std::string::npos; };
+
+    auto entries = corpus();
+    validateCorpus(entries);
+
+    if (selected("parse")) benchParse(entries);
+    if (selected("chunked")) benchLargeHeaders();
+    if (selected("json")) benchJson();
+    if (selected("response")) benchResponse();
+    if (selected("messages")) benchMessages();
+    if (selected("utils")) benchUtils();
+    if (selected("log")) benchLogging();
+    if (selected("metrics")) benchMetrics();
+    if (selected("timers")) benchTimers();
+    if (selected("router")) benchRouter();
+    if (selected("trace")) benchTracing();
+    if (selected("allocs")) {
+        bool ok = checkAllocations(IoMode::Threaded, "threaded", 18471);
+#ifdef __linux__
+        ok = checkAllocations(IoMode::Epoll, "epoll", 18472) && ok;
+#endif
+#ifdef LANCHAT_HAVE_IO_URING
+        ok = checkAllocations(IoMode::IoUring, "uring", 18473) && ok;
+#endif
+        if (!ok) {
+            std::fprintf(stderr, "allocation check failed: a request allocated or got the wrong status\n");
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,513 @@
+// Load generator for the lanchat HTTP API.
+//
+//   lanchat_loadgen [options]
+//
+//   --port P          Server on 127.0.0.1 to load (default 8080)
+//   --local MODE      Start an in-process server on a scratch message store
+//                     instead: threaded, epoll, io_uring, or all to run each
+//                     in turn for comparison
+//   --connections N   Concurrent connections, one thread each (default 16)
+//   --duration S      Measured seconds (default 10)
+//   --warmup S        Unmeasured seconds before that (default 2)
+//   --rate R          Open loop: R requests/s in total, spread evenly over the
+//                     connections. 0 (default) is closed loop: each connection
+//                     sends as soon as its previous reply arrives.
+//   --mix G,P,R       Weights of GET /messages, POST /messages and GET /peers
+//                     (default 8,1,1)
+//   --no-keepalive    Open a new connection for every request
+//   --max-connections N
+//                     With --local: the server's connection limit, past which
+//                     it sheds with 503 (default: no limit)
+//   --json            One JSON object per run instead of a report
+//
+// Latency percentiles are corrected for coordinated omission. In open loop
+// every request is timed from when it was scheduled to go out, so a stalled
+// server is charged for the requests it held back. In closed loop the raw
+// histogram is corrected afterwards the way HdrHistogram does. A connection
+// sends back to back, so the mean latency is its expected interval between
+// requests. The raw figures are shown too. Requests shed with 503 are
+// counted apart and left out of the latencies; in closed loop the
+// connection then waits out the server's Retry-After.
+
+#include "http/http_server.hpp"
+#include "message/message_handler.hpp"
+#include "network/peer_discovery.hpp"
+#include "network/sockets.hpp"
+#include "util/log.hpp"
+#include "util/metrics.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+#ifdef MSG_NOSIGNAL
+const int kSendFlags = MSG_NOSIGNAL;  // A server closing first must not kill the generator
+#else
+const int kSendFlags = 0;
+#endif
+
+enum Kind { GetMessages, PostMessage, GetPeers, kKinds };
+const char* const kKindNames[] = {"GET /messages", "POST /messages", "GET /peers"};
+
+struct Options {
+    int port = 8080;
+    std::vector<IoMode> localModes;  // Empty: load an external server
+    unsigned connections = 16;
+    double duration = 10;
+    double warmup = 2;
+    double rate = 0;
+    unsigned mix[kKinds] = {8, 1, 1};
+    bool keepAlive = true;
+    size_t maxConnections = 0;
+    bool json = false;
+};
+
+const char* modeName(IoMode mode) {
+    switch (mode) {
+    case IoMode::Threaded: return "threaded";
+    case IoMode::Epoll: return "epoll";
+    default: return "io_uring";
+    }
+}
+
+// Blocking HTTP/1.1 client for one connection. Reads whole responses,
+// including chunked ones, and reconnects when the server closes.
+class Client {
+public:
+    explicit Client(int port) : port(port) {}
+    ~Client() { disconnect(); }
+
+    // Status code, or -1 if the exchange failed
+    int exchange(const std::string& request, bool keepAlive) {
+        if (sock == INVALID_SOCKET && !connect()) return -1;
+        if (!sendAll(request)) {
+            disconnect();
+            return -1;
+        }
+        bool close = false;
+        int status = readResponse(close);
+        if (status < 0 || close || !keepAlive) disconnect();
+        return status;
+    }
+
+    uint64_t connects = 0;
+    int retryAfter = 0;  // Seconds, from the last response
+
+private:
+    bool connect() {
+        sock = socket(AF_INET, SOCK_STREAM, 0);
+        if (sock == INVALID_SOCKET) return false;
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(static_cast<uint16_t>(port));
+        inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+        if (::connect(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+            disconnect();
+            return false;
+        }
+        // A stuck server must not hang the run
+#ifdef _WIN32
+        DWORD timeout = 10000;
+#else
+        timeval timeout{10, 0};
+#endif
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&timeout), sizeof(timeout));
+        ++connects;
+        buf.clear();
+        return true;
+    }
+
+    void disconnect() {
+        if (sock != INVALID_SOCKET) CLOSE_SOCKET(sock);
+        sock = INVALID_SOCKET;
+    }
+
+    bool sendAll(std::string_view data) {
+        while (!data.empty()) {
+            int n = ::send(sock, data.data(), static_cast<int>(data.size()), kSendFlags);
+            if (n <= 0) return false;
+            data.remove_prefix(static_cast<size_t>(n));
+        }
+        return true;
+    }
+
+    // Appends more input to buf; false on close or error
+    bool fill() {
+        char tmp[64 * 1024];
+        int n = ::recv(sock, tmp, sizeof(tmp), 0);
+        if (n <= 0) return false;
+        buf.append(tmp, static_cast<size_t>(n));
+        return true;
+    }
+
+    // Makes sure buf holds a line ending at or after from; returns its end
+    size_t lineEnd(size_t from) {
+        size_t end;
+        while ((end = buf.find("\r\n", from)) == std::string::npos) {
+            if (!fill()) return std::string::npos;
+        }
+        return end;
+    }
+
+    // Value of the first header called name (given in lower case)
+    static bool header(std::string_view head, std::string_view name, std::string_view& value) {
+        size_t pos = 0;
+        while ((pos = head.find("\r\n", pos)) != std::string_view::npos) {
+            pos += 2;
+            std::string_view line = head.substr(pos, head.find("\r\n", pos) - pos);
+            if (line.size() <= name.size() || line[name.size()] != ':') continue;
+            bool match = true;
+            for (size_t i = 0; i < name.size() && match; ++i) {
+                match = std::tolower(static_cast<unsigned char>(line[i])) == name[i];
+            }
+            if (match) {
+                value = line.substr(name.size() + 1);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    int readResponse(bool& close) {
+        size_t headEnd;
+        while ((headEnd = buf.find("\r\n\r\n")) == std::string::npos) {
+            if (!fill()) return -1;
+        }
+        std::string_view head(buf.data(), headEnd + 2);
+        if (head.size() < 12) return -1;
+        int status = std::atoi(head.data() + 9);
+        std::string_view value;
+        close = header(head, "connection", value) && value.find("close") != std::string_view::npos;
+        retryAfter = header(head, "retry-after", value) ? std::atoi(std::string(value).c_str()) : 0;
+        size_t bodyStart = headEnd + 4;
+
+        if (header(head, "transfer-encoding", value) && value.find("chunked") != std::string_view::npos) {
+            size_t pos = bodyStart;
+            while (true) {
+                size_t end = lineEnd(pos);
+                if (end == std::string::npos) return -1;
+                size_t size = std::strtoul(buf.c_str() + pos, nullptr, 16);
+                pos = end + 2;
+                if (size == 0) {
+                    // Skip trailers up to the blank line
+                    while ((end = lineEnd(pos)) != pos) {
+                        if (end == std::string::npos) return -1;
+                        pos = end + 2;
+                    }
+                    buf.erase(0, pos + 2);
+                    return status;
+                }
+                while (buf.size() < pos + size + 2) {
+                    if (!fill()) return -1;
+                }
+                // Drop what has been read so a long stream does not pile up
+                buf.erase(0, pos + size + 2);
+                pos = 0;
+            }
+        }
+
+        if (!header(head, "content-length", value)) {
+            // Delimited by the end of the connection
+            while (fill()) {
+            }
+            close = true;
+            buf.clear();
+            return status;
+        }
+        size_t length = std::strtoul(std::string(value).c_str(), nullptr, 10);
+        while (buf.size() < bodyStart + length) {
+            if (!fill()) return -1;
+        }
+        buf.erase(0, bodyStart + length);
+        return status;
+    }
+
+    int port;
+    SOCKET sock = INVALID_SOCKET;
+    std::string buf;
+};
+
+struct Run {
+    Clock::time_point start;
+    Clock::time_point measureFrom;
+    Clock::time_point end;
+    Metrics::Histogram latency[kKinds];
+    std::atomic<uint64_t> completed[kKinds] = {};
+    std::atomic<uint64_t> errors{0};
+    std::atomic<uint64_t> shed{0};  // 503s
+    std::atomic<uint64_t> connects{0};
+};
+
+std::string buildRequest(Kind kind, bool keepAlive) {
+    std::string req = kind == PostMessage ? "POST /messages HTTP/1.1\r\n"
+                      : kind == GetPeers  ? "GET /peers HTTP/1.1\r\n"
+                                          : "GET /messages HTTP/1.1\r\n";
+    req += "Host: 127.0.0.1\r\n";
+    if (!keepAlive) req += "Connection: close\r\n";
+    if (kind == PostMessage) {
+        std::string body = "{\"user\":\"loadgen\",\"message\":\"load test message\"}";
+        req += "Content-Type: application/json\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n";
+        req += body;
+        return req;
+    }
+    return req + "\r\n";
+}
+
+void runConnection(const Options& opt, Run& run, unsigned index, int port) {
+    std::string requests[kKinds];
+    for (int k = 0; k < kKinds; ++k) requests[k] = buildRequest(static_cast<Kind>(k), opt.keepAlive);
+    unsigned totalWeight = opt.mix[0] + opt.mix[1] + opt.mix[2];
+    uint64_t rng = 0x9E3779B97F4A7C15ull * (index + 1);
+
+    Client client(port);
+    bool openLoop = opt.rate > 0;
+    auto interval = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(openLoop ? opt.connections / opt.rate : 0));
+    // Stagger the connections' schedules across one interval
+    Clock::time_point next = run.start + interval * index / opt.connections;
+    while (true) {
+        Clock::time_point sendAt;
+        if (openLoop) {
+            if (next >= run.end) break;
+            std::this_thread::sleep_until(next);
+            sendAt = next;  // Late sends are still timed from their slot
+            next += interval;
+        } else {
+            sendAt = Clock::now();
+            if (sendAt >= run.end) break;
+        }
+
+        rng ^= rng << 13;
+        rng ^= rng >> 7;
+        rng ^= rng << 17;
+        unsigned pick = static_cast<unsigned>(rng % totalWeight);
+        int kind = 0;
+        while (pick >= opt.mix[kind]) pick -= opt.mix[kind++];
+
+        int status = client.exchange(requests[kind], opt.keepAlive);
+        auto done = Clock::now();
+        if (status == 503) {
+            // A closed-loop client backs off as told; an open-loop one keeps
+            // to its schedule
+            if (!openLoop && client.retryAfter > 0) {
+                std::this_thread::sleep_until(std::min(run.end, done + std::chrono::seconds(client.retryAfter)));
+            }
+            if (sendAt >= run.measureFrom) run.shed.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        if (sendAt < run.measureFrom) continue;
+        if (status < 200 || status >= 300) {
+            run.errors.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        run.latency[kind].record(done - sendAt);
+        run.completed[kind].fetch_add(1, std::memory_order_relaxed);
+    }
+    run.connects.fetch_add(client.connects, std::memory_order_relaxed);
+}
+
+// HdrHistogram's copyCorrectedForCoordinatedOmission: a sample longer than
+// the expected interval implies the requests that could not be sent while it
+// was outstanding, at latencies shrinking by one interval each
+Metrics::Histogram::Snapshot corrected(const Metrics::Histogram::Snapshot& raw, uint64_t intervalNs) {
+    Metrics::Histogram::Snapshot out = raw;
+    if (intervalNs == 0) return out;
+    for (size_t i = 0; i < Metrics::Histogram::kBuckets; ++i) {
+        if (raw.counts[i] == 0) continue;
+        uint64_t value = Metrics::Histogram::upperBound(i);
+        for (uint64_t missing = value > intervalNs ? value - intervalNs : 0; missing >= intervalNs;
+             missing -= intervalNs) {
+            out.counts[Metrics::Histogram::bucketOf(missing)] += raw.counts[i];
+            out.count += raw.counts[i];
+            out.sum += missing * raw.counts[i];
+        }
+    }
+    return out;
+}
+
+Metrics::Histogram::Snapshot merge(const Metrics::Histogram::Snapshot* parts, size_t n) {
+    Metrics::Histogram::Snapshot out;
+    for (size_t p = 0; p < n; ++p) {
+        for (size_t i = 0; i < Metrics::Histogram::kBuckets; ++i) out.counts[i] += parts[p].counts[i];
+        out.count += parts[p].count;
+        out.sum += parts[p].sum;
+    }
+    return out;
+}
+
+double ms(uint64_t ns) {
+    return ns / 1e6;
+}
+
+void printLatency(const char* label, const Metrics::Histogram::Snapshot& s) {
+    std::printf("  %-16s n=%-9llu p50 %8.3f ms  p99 %8.3f ms  p99.9 %8.3f ms  max %8.3f ms\n", label,
+                static_cast<unsigned long long>(s.count), ms(s.quantile(0.5)), ms(s.quantile(0.99)),
+                ms(s.quantile(0.999)), ms(s.quantile(1.0)));
+}
+
+void runLoad(const Options& opt, const char* target, int port) {
+    Run run;
+    run.start = Clock::now() + std::chrono::milliseconds(50);  // Let every thread reach its first slot
+    run.measureFrom = run.start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(opt.warmup));
+    run.end = run.measureFrom + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(opt.duration));
+
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < opt.connections; ++i) threads.emplace_back(runConnection, std::cref(opt), std::ref(run), i, port);
+    for (auto& t : threads) t.join();
+
+    Metrics::Histogram::Snapshot raw[kKinds];
+    Metrics::Histogram::Snapshot fixed[kKinds];
+    uint64_t completed = 0;
+    for (int k = 0; k < kKinds; ++k) {
+        raw[k] = run.latency[k].snapshot();
+        completed += run.completed[k].load();
+    }
+    Metrics::Histogram::Snapshot allRaw = merge(raw, kKinds);
+    bool openLoop = opt.rate > 0;
+    // Open-loop samples already include any wait for their slot
+    uint64_t interval = openLoop || allRaw.count == 0 ? 0 : allRaw.sum / allRaw.count;
+    for (int k = 0; k < kKinds; ++k) fixed[k] = corrected(raw[k], interval);
+    Metrics::Histogram::Snapshot all = merge(fixed, kKinds);
+    double rps = completed / opt.duration;
+    uint64_t errors = run.errors.load();
+    uint64_t shed = run.shed.load();
+
+    if (opt.json) {
+        std::printf("{\"target\":\"%s\",\"loop\":\"%s\",\"rate\":%.0f,\"connections\":%u,\"keepalive\":%s,"
+                    "\"requests\":%llu,\"errors\":%llu,\"shed\":%llu,\"connects\":%llu,\"rps\":%.1f,"
+                    "\"p50_ms\":%.3f,\"p99_ms\":%.3f,\"p999_ms\":%.3f,\"max_ms\":%.3f,"
+                    "\"raw_p50_ms\":%.3f,\"raw_p99_ms\":%.3f,\"raw_p999_ms\":%.3f}\n",
+                    target, openLoop ? "open" : "closed", opt.rate, opt.connections, opt.keepAlive ? "true" : "false",
+                    static_cast<unsigned long long>(completed), static_cast<unsigned long long>(errors),
+                    static_cast<unsigned long long>(shed), static_cast<unsigned long long>(run.connects.load()), rps,
+                    ms(all.quantile(0.5)), ms(all.quantile(0.99)), ms(all.quantile(0.999)), ms(all.quantile(1.0)),
+                    ms(allRaw.quantile(0.5)), ms(allRaw.quantile(0.99)), ms(allRaw.quantile(0.999)));
+        return;
+    }
+    std::printf("%s: %s loop", target, openLoop ? "open" : "closed");
+    if (openLoop) std::printf(" at %.0f req/s", opt.rate);
+    std::printf(", %u connections, %s, mix %u:%u:%u\n", opt.connections, opt.keepAlive ? "keep-alive" : "no keep-alive",
+                opt.mix[0], opt.mix[1], opt.mix[2]);
+    std::printf("  %llu requests in %.1f s = %.1f req/s, %llu errors, %llu shed, %llu connects\n",
+                static_cast<unsigned long long>(completed), opt.duration, rps, static_cast<unsigned long long>(errors),
+                static_cast<unsigned long long>(shed),
+                static_cast<unsigned long long>(run.connects.load()));
+    printLatency("all (corrected)", all);
+    if (!openLoop) printLatency("all (raw)", allRaw);
+    for (int k = 0; k < kKinds; ++k) {
+        if (opt.mix[k]) printLatency(kKindNames[k], fixed[k]);
+    }
+}
+
+// Scratch store and server for --local; peer discovery is not started
+class LocalServer {
+public:
+    LocalServer(IoMode mode, int port, size_t maxConnections) : messages(store.path.string()) {
+        HttpServerConfig config;
+        config.ioMode = mode;
+        config.maxConnections = maxConnections;
+        server = std::make_unique<HttpServer>(port, messages, peers, config);
+        server->start();
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    ~LocalServer() { server->stop(); }
+
+private:
+    struct Store {
+        std::filesystem::path path = std::filesystem::temp_directory_path() / "lanchat_loadgen_messages.json";
+        Store() { std::filesystem::remove(path); }
+        ~Store() { std::filesystem::remove(path); }
+    } store;
+    MessageHandler messages;
+    PeerDiscovery peers;
+    std::unique_ptr<HttpServer> server;
+};
+
+bool parseMix(const char* text, unsigned mix[kKinds]) {
+    unsigned values[kKinds];
+    if (std::sscanf(text, "%u,%u,%u", &values[0], &values[1], &values[2]) != 3) return false;
+    if (values[0] + values[1] + values[2] == 0) return false;
+    std::copy(values, values + kKinds, mix);
+    return true;
+}
+
+bool parseMode(const std::string& name, std::vector<IoMode>& modes) {
+    if (name == "threaded") modes = {IoMode::Threaded};
+    else if (name == "epoll") modes = {IoMode::Epoll};
+    else if (name == "io_uring") modes = {IoMode::IoUring};
+    else if (name == "all") modes = {IoMode::Threaded, IoMode::Epoll, IoMode::IoUring};
+    else return false;
+    return true;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    Options opt;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--port" && hasValue) {
+            opt.port = std::atoi(argv[++i]);
+        } else if (arg == "--local" && hasValue) {
+            if (!parseMode(argv[++i], opt.localModes)) {
+                std::fprintf(stderr, "Unknown I/O mode: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (arg == "--connections" && hasValue) {
+            opt.connections = static_cast<unsigned>(std::max(1, std::atoi(argv[++i])));
+        } else if (arg == "--duration" && hasValue) {
+            opt.duration = std::atof(argv[++i]);
+        } else if (arg == "--warmup" && hasValue) {
+            opt.warmup = std::atof(argv[++i]);
+        } else if (arg == "--rate" && hasValue) {
+            opt.rate = std::atof(argv[++i]);
+        } else if (arg == "--mix" && hasValue) {
+            if (!parseMix(argv[++i], opt.mix)) {
+                std::fprintf(stderr, "--mix takes three weights, e.g. 8,1,1\n");
+                return 1;
+            }
+        } else if (arg == "--max-connections" && hasValue) {
+            opt.maxConnections = static_cast<size_t>(std::max(0, std::atoi(argv[++i])));
+        } else if (arg == "--no-keepalive") {
+            opt.keepAlive = false;
+        } else if (arg == "--json") {
+            opt.json = true;
+        } else {
+            std::fprintf(stderr, "Unknown option: %s\n", arg.c_str());
+            return 1;
+        }
+    }
+    if (opt.duration <= 0) {
+        std::fprintf(stderr, "--duration must be positive\n");
+        return 1;
+    }
+
+    SocketUtils::initialize();
+    if (opt.localModes.empty()) {
+        runLoad(opt, ("127.0.0.1:" + std::to_string(opt.port)).c_str(), opt.port);
+    } else {
+        Log::setLevel(Log::Level::Warn);
+        int port = 18480;
+        for (IoMode mode : opt.localModes) {
+            LocalServer local(mode, port, opt.maxConnections);
+            runLoad(opt, modeName(mode), port);
+            ++port;  // A fresh port each time, clear of the last run's TIME_WAIT sockets
+        }
+    }
+    SocketUtils::cleanup();
+    return 0;
+}
@@ -0,0 +1,270 @@
+// Peer discovery at scale: thousands of virtual PeerDiscovery instances in
+// one process, announcing to each other on a simulated clock.
+//
+//   lanchat_peersim [options]
+//
+//   --peers N         Virtual peers on one flat segment (default 1000)
+//   --transport T     memory (default): announcements are handed straight to
+//                     every other peer. loopback: each announcement is sent
+//                     as a real UDP datagram to 127.0.0.1 and fanned out to
+//                     the peers when it is received, as a broadcast would be.
+//   --loss P          Chance that a peer misses a given announcement (default 0)
+//   --duration S      Simulated seconds (default 60)
+//   --interval S      Seconds between announcements (default 5)
+//   --expiry S        Seconds of silence before a peer is dropped (default 30)
+//   --seed N          Random seed for start offsets and loss (default 1)
+//   --json            One JSON object instead of a report
+//
+// Peers start at random offsets within the first interval. Every interval
+// each one expires its table, as a GET /peers would. The simulator reports
+// the CPU spent handling one received announcement and extrapolates it to a
+// real node, which hears one from every other peer each interval. It also
+// reports how long the segment takes to converge on the full peer set, how
+// many peers are dropped by expiry, and how long cleanupExpired and
+// getActivePeers take on a full table.
+
+#include "network/peer_discovery.hpp"
+#include "network/sockets.hpp"
+#include "util/log.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    size_t peers = 1000;
+    bool loopback = false;
+    double loss = 0;
+    double duration = 60;
+    int interval = 5;
+    int expiry = 30;
+    unsigned seed = 1;
+    bool json = false;
+};
+
+const int kLoopbackPort = 18490;
+
+// Carries one peer's announcement to the others
+class Transport {
+public:
+    virtual ~Transport() = default;
+    // The datagram as the receivers see it, with the sender's address
+    virtual bool carry(const std::string& datagram, std::string& received, std::string& address) = 0;
+};
+
+class MemoryTransport : public Transport {
+public:
+    bool carry(const std::string& datagram, std::string& received, std::string& address) override {
+        received = datagram;
+        address = "10.0.0.1";
+        return true;
+    }
+};
+
+class LoopbackTransport : public Transport {
+public:
+    LoopbackTransport() {
+        if (!receiver.bind(kLoopbackPort)) std::fprintf(stderr, "Cannot bind UDP port %d\n", kLoopbackPort);
+    }
+    bool carry(const std::string& datagram, std::string& received, std::string& address) override {
+        int fromPort;
+        return sender.sendTo(datagram, "127.0.0.1", kLoopbackPort) && receiver.receiveFrom(received, address, fromPort);
+    }
+
+private:
+    UDPSocket sender;
+    UDPSocket receiver;
+};
+
+struct Result {
+    uint64_t announcements = 0;
+    uint64_t deliveries = 0;
+    uint64_t lost = 0;
+    uint64_t expired = 0;
+    double deliverNs = 0;     // Wall time per delivered announcement
+    double cpuNs = 0;         // Process CPU time per delivered announcement
+    double convergedAt = -1;  // Simulated seconds, -1 if never
+    double convergedFraction = 0;
+    size_t datagramBytes = 0;
+    double activePeersUs = 0;
+    double cleanupUs = 0;
+};
+
+double seconds(Clock::duration d) {
+    return std::chrono::duration<double>(d).count();
+}
+
+Result simulate(const Options& opt, Transport& transport) {
+    std::mt19937 rng(opt.seed);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    const Clock::time_point epoch = Clock::now();
+    const auto at = [&](double s) { return epoch + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(s)); };
+
+    std::vector<std::unique_ptr<PeerDiscovery>> peers;
+    std::vector<double> nextAnnounce;
+    std::vector<size_t> known(opt.peers, 0);
+    for (size_t i = 0; i < opt.peers; ++i) {
+        PeerDiscoveryConfig config;
+        config.peerId = "peer_" + std::to_string(i);
+        config.announceInterval = std::chrono::seconds(opt.interval);
+        config.expiry = std::chrono::seconds(opt.expiry);
+        peers.push_back(std::make_unique<PeerDiscovery>(config));
+        nextAnnounce.push_back(unit(rng) * opt.interval);
+    }
+
+    Result result;
+    size_t complete = 0;  // Peers that know every other peer
+    const size_t everyone = opt.peers - 1;
+    Clock::duration delivering{};
+    std::clock_t cpu = 0;
+    std::string received, address;
+    for (double interval = 0; interval < opt.duration; interval += opt.interval) {
+        // Announcements due within this interval, in time order
+        std::vector<std::pair<double, size_t>> due;
+        for (size_t i = 0; i < opt.peers; ++i) {
+            if (nextAnnounce[i] < interval + opt.interval) due.emplace_back(nextAnnounce[i], i);
+        }
+        std::sort(due.begin(), due.end());
+        for (const auto& [time, sender] : due) {
+            nextAnnounce[sender] += opt.interval;
+            if (time >= opt.duration) continue;
+            Clock::time_point now = at(time);
+            auto started = Clock::now();
+            std::clock_t cpuStarted = std::clock();
+            std::string datagram = peers[sender]->announcement();
+            result.datagramBytes = datagram.size();
+            ++result.announcements;
+            if (!transport.carry(datagram, received, address)) continue;
+            for (size_t i = 0; i < opt.peers; ++i) {
+                if (i == sender) continue;
+                if (opt.loss > 0 && unit(rng) < opt.loss) {
+                    ++result.lost;
+                    continue;
+                }
+                ++result.deliveries;
+                if (peers[i]->receive(received, address, now) && ++known[i] == everyone) ++complete;
+            }
+            cpu += std::clock() - cpuStarted;
+            delivering += Clock::now() - started;
+            if (complete == opt.peers && result.convergedAt < 0) result.convergedAt = time;
+        }
+        // Everyone expires once per interval, as a GET /peers would
+        Clock::time_point end = at(interval + opt.interval);
+        for (size_t i = 0; i < opt.peers; ++i) {
+            size_t dropped = peers[i]->expire(end);
+            if (dropped == 0) continue;
+            if (known[i] == everyone) --complete;
+            known[i] -= dropped;
+            result.expired += dropped;
+        }
+    }
+    if (result.deliveries) {
+        result.deliverNs = std::chrono::duration<double, std::nano>(delivering).count() / result.deliveries;
+        result.cpuNs = cpu * 1e9 / CLOCKS_PER_SEC / result.deliveries;
+    }
+    result.convergedFraction = static_cast<double>(complete) / opt.peers;
+
+    // Table operations on a peer that knows everyone it heard from
+    size_t largest = std::max_element(known.begin(), known.end()) - known.begin();
+    PeerDiscovery& full = *peers[largest];
+    Clock::time_point now = at(opt.duration);
+    const int reps = 20;
+    auto started = Clock::now();
+    size_t listed = 0;
+    for (int r = 0; r < reps; ++r) listed += full.getActivePeers(now).size();
+    result.activePeersUs = seconds(Clock::now() - started) * 1e6 / reps;
+    started = Clock::now();
+    for (int r = 0; r < reps; ++r) full.expire(now);
+    result.cleanupUs = seconds(Clock::now() - started) * 1e6 / reps;
+    if (listed == 0 && opt.peers > 1) std::fprintf(stderr, "largest table is empty\n");
+    return result;
+}
+
+void report(const Options& opt, const Result& r) {
+    // A real node hears every other peer once per interval
+    double perNodeCpu = r.cpuNs * (opt.peers - 1) / opt.interval / 1e9;
+    double perNodeBytes = static_cast<double>(r.datagramBytes) * (opt.peers - 1) / opt.interval;
+    if (opt.json) {
+        std::printf("{\"peers\":%zu,\"transport\":\"%s\",\"loss\":%.3f,\"duration_s\":%.0f,\"interval_s\":%d,"
+                    "\"announcements\":%llu,\"deliveries\":%llu,\"receive_ns\":%.1f,\"receive_cpu_ns\":%.1f,"
+                    "\"node_cpu_share\":%.6f,\"node_bytes_per_s\":%.0f,\"converged_s\":%.2f,\"converged_fraction\":%.4f,"
+                    "\"expired\":%llu,\"get_active_peers_us\":%.1f,\"cleanup_expired_us\":%.1f}\n",
+                    opt.peers, opt.loopback ? "loopback" : "memory", opt.loss, opt.duration, opt.interval,
+                    static_cast<unsigned long long>(r.announcements), static_cast<unsigned long long>(r.deliveries),
+                    r.deliverNs, r.cpuNs, perNodeCpu, perNodeBytes, r.convergedAt, r.convergedFraction,
+                    static_cast<unsigned long long>(r.expired), r.activePeersUs, r.cleanupUs);
+        return;
+    }
+    std::printf("%zu peers over %s, %.0f%% loss, %.0f s simulated, announce every %d s, expire after %d s\n", opt.peers,
+                opt.loopback ? "loopback UDP" : "memory", opt.loss * 100, opt.duration, opt.interval, opt.expiry);
+    std::printf("  %llu announcements, %llu deliveries, %llu lost\n", static_cast<unsigned long long>(r.announcements),
+                static_cast<unsigned long long>(r.deliveries), static_cast<unsigned long long>(r.lost));
+    std::printf("  receive   %.0f ns wall, %.0f ns CPU per announcement heard\n", r.deliverNs, r.cpuNs);
+    std::printf("  per node  %.3f%% of a core and %.0f bytes/s to hear every other peer\n", perNodeCpu * 100,
+                perNodeBytes);
+    if (r.convergedAt >= 0) {
+        std::printf("  converged after %.2f s", r.convergedAt);
+    } else {
+        std::printf("  never converged");
+    }
+    std::printf(", %.1f%% of peers complete at the end, %llu expirations\n", r.convergedFraction * 100,
+                static_cast<unsigned long long>(r.expired));
+    std::printf("  getActivePeers %.1f us, cleanupExpired %.1f us on a full table\n", r.activePeersUs, r.cleanupUs);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    Options opt;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--peers" && hasValue) {
+            opt.peers = static_cast<size_t>(std::max(2, std::atoi(argv[++i])));
+        } else if (arg == "--transport" && hasValue) {
+            std::string name = argv[++i];
+            if (name != "memory" && name != "loopback") {
+                std::fprintf(stderr, "Unknown transport: %s\n", name.c_str());
+                return 1;
+            }
+            opt.loopback = name == "loopback";
+        } else if (arg == "--loss" && hasValue) {
+            opt.loss = std::min(1.0, std::max(0.0, std::atof(argv[++i])));
+        } else if (arg == "--duration" && hasValue) {
+            opt.duration = std::atof(argv[++i]);
+        } else if (arg == "--interval" && hasValue) {
+            opt.interval = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--expiry" && hasValue) {
+            opt.expiry = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--seed" && hasValue) {
+            opt.seed = static_cast<unsigned>(std::atoi(argv[++i]));
+        } else if (arg == "--json") {
+            opt.json = true;
+        } else {
+            std::fprintf(stderr, "Unknown option: %s\n", arg.c_str());
+            return 1;
+        }
+    }
+
+    Log::setLevel(Log::Level::Warn);
+    SocketUtils::initialize();
+    std::unique_ptr<Transport> transport;
+    if (opt.loopback) {
+        transport = std::make_unique<LoopbackTransport>();
+    } else {
+        transport = std::make_unique<MemoryTransport>();
+    }
+    Result result = simulate(opt, *transport);
+    report(opt, result);
+    SocketUtils::cleanup();
+    return 0;
+}
@@ -0,0 +1,270 @@
+// Benchmark of MessageHandler's persistence modes, to choose one from data.
+//
+//   lanchat_storebench [options]
+//
+//   --mode MODE     rewrite, log, group, or all (default) to run each in turn
+//   --writers N     Threads calling addMessage (default 4)
+//   --readers N     Threads calling snapshot() while they do (default 1)
+//   --messages N    Messages appended per run, split over the writers (default 2000)
+//   --history N     Messages already stored when a run starts (default 1000)
+//   --size B        Bytes of text per message (default 100)
+//   --no-sync       Only write() to the page cache, as the server does
+//                   without --fsync, instead of syncing every write
+//   --json          One JSON object per run instead of a report
+//
+// Each run starts from a freshly written history file and reports the time
+// to open it, append throughput and latency, snapshot latency under that
+// write load, bytes written to disk per appended message, the time to shut
+// down, and the time to recover from a copy of the files taken before
+// shutdown, as if the process had been killed there.
+
+#include "message/message_handler.hpp"
+#include "util/log.hpp"
+#include "util/metrics.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+namespace fs = std::filesystem;
+
+struct Options {
+    std::vector<StoreMode> modes = {StoreMode::Rewrite, StoreMode::AppendLog, StoreMode::GroupCommit};
+    unsigned writers = 4;
+    unsigned readers = 1;
+    size_t messages = 2000;
+    size_t history = 1000;
+    size_t size = 100;
+    bool sync = true;
+    bool json = false;
+};
+
+const char* modeName(StoreMode mode) {
+    switch (mode) {
+    case StoreMode::Rewrite: return "rewrite";
+    case StoreMode::AppendLog: return "log";
+    default: return "group";
+    }
+}
+
+bool parseMode(const std::string& name, std::vector<StoreMode>& modes) {
+    if (name == "rewrite") modes = {StoreMode::Rewrite};
+    else if (name == "log") modes = {StoreMode::AppendLog};
+    else if (name == "group") modes = {StoreMode::GroupCommit};
+    else if (name != "all") return false;
+    return true;
+}
+
+double msSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+double us(uint64_t ns) {
+    return ns / 1e3;
+}
+
+std::vector<Message> makeMessages(size_t count, size_t size, size_t firstId) {
+    std::vector<Message> out;
+    out.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        Message msg("bench", std::string(size, static_cast<char>('a' + i % 26)));
+        msg.id = std::to_string(firstId + i);
+        msg.generateTimestamp();
+        out.push_back(std::move(msg));
+    }
+    return out;
+}
+
+void removeStore(const fs::path& path) {
+    std::error_code ec;
+    fs::remove(path, ec);
+    fs::remove(path.string() + ".log", ec);
+}
+
+void copyStore(const fs::path& from, const fs::path& to) {
+    removeStore(to);
+    const auto options = fs::copy_options::overwrite_existing;
+    if (fs::exists(from)) fs::copy_file(from, to, options);
+    fs::path log = from.string() + ".log";
+    if (fs::exists(log)) fs::copy_file(log, to.string() + ".log", options);
+}
+
+struct Result {
+    double startupMs = 0;
+    double appendSeconds = 0;
+    Metrics::Histogram::Snapshot append;
+    Metrics::Histogram::Snapshot reads;
+    uint64_t written = 0;
+    uint64_t flushes = 0;
+    double shutdownMs = 0;
+    double recoveryMs = 0;
+    size_t recovered = 0;
+};
+
+Result runMode(const Options& opt, StoreMode mode, const fs::path& dir) {
+    fs::path path = dir / "messages.json";
+    fs::path crashed = dir / "crashed.json";
+    removeStore(path);
+    {
+        MessageHandler seed(path.string());
+        seed.addMessages(makeMessages(opt.history, opt.size, 0));
+    }
+
+    Result result;
+    Metrics::Histogram appendTimes;
+    Metrics::Histogram readTimes;
+    std::vector<std::vector<Message>> work(opt.writers);
+    for (unsigned w = 0; w < opt.writers; ++w) {
+        size_t count = opt.messages / opt.writers + (w < opt.messages % opt.writers ? 1 : 0);
+        work[w] = makeMessages(count, opt.size, opt.history + w * (opt.messages / opt.writers + 1));
+    }
+
+    auto opened = Clock::now();
+    auto store = std::make_unique<MessageHandler>(path.string(), mode, opt.sync);
+    result.startupMs = msSince(opened);
+    uint64_t writtenBefore = store->stats().written;
+    uint64_t flushesBefore = store->flushDurations().snapshot().count;
+
+    std::atomic<bool> writing{true};
+    std::vector<std::thread> readers;
+    for (unsigned r = 0; r < opt.readers; ++r) {
+        readers.emplace_back([&] {
+            size_t seen = 0;
+            while (writing.load(std::memory_order_relaxed)) {
+                auto start = Clock::now();
+                auto view = store->snapshot();
+                readTimes.recordSince(start);
+                seen += view->size();
+            }
+            if (seen == 0) std::fprintf(stderr, "reader saw no messages\n");
+        });
+    }
+    auto started = Clock::now();
+    std::vector<std::thread> writers;
+    for (unsigned w = 0; w < opt.writers; ++w) {
+        writers.emplace_back([&, w] {
+            for (const Message& msg : work[w]) {
+                auto start = Clock::now();
+                store->addMessage(msg);
+                appendTimes.recordSince(start);
+            }
+        });
+    }
+    for (auto& t : writers) t.join();
+    result.appendSeconds = std::chrono::duration<double>(Clock::now() - started).count();
+    writing = false;
+    for (auto& t : readers) t.join();
+
+    result.append = appendTimes.snapshot();
+    result.reads = readTimes.snapshot();
+    result.written = store->stats().written - writtenBefore;
+    result.flushes = store->flushDurations().snapshot().count - flushesBefore;
+
+    copyStore(path, crashed);
+    auto closing = Clock::now();
+    store.reset();
+    result.shutdownMs = msSince(closing);
+
+    auto recovering = Clock::now();
+    {
+        MessageHandler recovered(crashed.string(), mode, opt.sync);
+        result.recoveryMs = msSince(recovering);
+        result.recovered = recovered.stats().messages;
+    }
+    removeStore(path);
+    removeStore(crashed);
+    return result;
+}
+
+void printLatency(const char* label, const Metrics::Histogram::Snapshot& s) {
+    std::printf("  %-9s n=%-8llu p50 %9.1f us  p99 %9.1f us  p99.9 %9.1f us  max %9.1f us\n", label,
+                static_cast<unsigned long long>(s.count), us(s.quantile(0.5)), us(s.quantile(0.99)),
+                us(s.quantile(0.999)), us(s.quantile(1.0)));
+}
+
+void report(const Options& opt, StoreMode mode, const Result& r) {
+    double perSecond = opt.messages / r.appendSeconds;
+    double bytesPerMessage = static_cast<double>(r.written) / opt.messages;
+    double perFlush = r.flushes ? static_cast<double>(opt.messages) / r.flushes : 0;
+    if (opt.json) {
+        std::printf("{\"mode\":\"%s\",\"sync\":%s,\"writers\":%u,\"readers\":%u,\"messages\":%zu,\"history\":%zu,\"size\":%zu,"
+                    "\"startup_ms\":%.3f,\"append_per_s\":%.1f,\"append_p50_us\":%.1f,\"append_p99_us\":%.1f,"
+                    "\"append_p999_us\":%.1f,\"snapshot_p50_us\":%.2f,\"snapshot_p99_us\":%.2f,"
+                    "\"bytes_per_message\":%.1f,\"messages_per_flush\":%.2f,\"shutdown_ms\":%.3f,"
+                    "\"recovery_ms\":%.3f,\"recovered\":%zu}\n",
+                    modeName(mode), opt.sync ? "true" : "false", opt.writers, opt.readers, opt.messages, opt.history,
+                    opt.size, r.startupMs,
+                    perSecond, us(r.append.quantile(0.5)), us(r.append.quantile(0.99)), us(r.append.quantile(0.999)),
+                    us(r.reads.quantile(0.5)), us(r.reads.quantile(0.99)), bytesPerMessage, perFlush, r.shutdownMs,
+                    r.recoveryMs, r.recovered);
+        return;
+    }
+    std::printf("%s%s: %u writers, %u readers, %zu messages of %zu bytes onto %zu\n", modeName(mode),
+                opt.sync ? "" : " (no sync)", opt.writers, opt.readers, opt.messages, opt.size, opt.history);
+    std::printf("  appended in %.3f s = %.0f messages/s\n", r.appendSeconds, perSecond);
+    printLatency("append", r.append);
+    if (opt.readers) printLatency("snapshot", r.reads);
+    std::printf("  written   %.0f bytes/message, %llu flushes (%.2f messages/flush)\n", bytesPerMessage,
+                static_cast<unsigned long long>(r.flushes), perFlush);
+    std::printf("  startup %.2f ms, shutdown %.2f ms, recovery %.2f ms (%zu messages)\n", r.startupMs, r.shutdownMs,
+                r.recoveryMs, r.recovered);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    Options opt;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--mode" && hasValue) {
+            if (!parseMode(argv[++i], opt.modes)) {
+                std::fprintf(stderr, "Unknown store mode: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (arg == "--writers" && hasValue) {
+            opt.writers = static_cast<unsigned>(std::max(1, std::atoi(argv[++i])));
+        } else if (arg == "--readers" && hasValue) {
+            opt.readers = static_cast<unsigned>(std::max(0, std::atoi(argv[++i])));
+        } else if (arg == "--messages" && hasValue) {
+            opt.messages = static_cast<size_t>(std::max(1, std::atoi(argv[++i])));
+        } else if (arg == "--history" && hasValue) {
+            opt.history = static_cast<size_t>(std::max(0, std::atoi(argv[++i])));
+        } else if (arg == "--size" && hasValue) {
+            opt.size = static_cast<size_t>(std::max(1, std::atoi(argv[++i])));
+        } else if (arg == "--no-sync") {
+            opt.sync = false;
+        } else if (arg == "--json") {
+            opt.json = true;
+        } else {
+            std::fprintf(stderr, "Unknown option: %s\n", arg.c_str());
+            return 1;
+        }
+    }
+
+    Log::setLevel(Log::Level::Warn);
+    fs::path dir = fs::temp_directory_path() / "lanchat_storebench";
+    fs::create_directories(dir);
+    int status = 0;
+    for (StoreMode mode : opt.modes) {
+        Result result = runMode(opt, mode, dir);
+        report(opt, mode, result);
+        if (result.recovered != opt.history + opt.messages) {
+            std::fprintf(stderr, "%s: recovered %zu messages, expected %zu\n", modeName(mode), result.recovered,
+                         opt.history + opt.messages);
+            status = 1;
+        }
+    }
+    std::error_code ec;
+    fs::remove_all(dir, ec);
+    return status;
+}
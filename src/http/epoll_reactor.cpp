@@ -0,0 +1,242 @@
+#ifdef __linux__
+
+#include "epoll_reactor.hpp"
+#include "http_server.hpp"
+#include "../util/log.hpp"
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <cerrno>
+#include <thread>
+#include <algorithm>
+
+namespace {
+const int kMaxEvents = 256;
+// Accepts per listener wakeup. The listener is level-triggered, so the rest
+// wait for the next round and a connect storm cannot starve open connections.
+const int kMaxAcceptBatch = 64;
+}
+
+EpollReactor::EpollReactor(HttpServer& srv, size_t loopCount, bool pin)
+    : server(srv), loops(loopCount == 0 ? 1 : loopCount), pinThreads(pin) {
+    for (auto& loop : loops) {
+        loop.epollFd = epoll_create1(EPOLL_CLOEXEC);
+        loop.wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = loop.wakeFd;
+        epoll_ctl(loop.epollFd, EPOLL_CTL_ADD, loop.wakeFd, &ev);
+    }
+}
+
+EpollReactor::~EpollReactor() {
+    for (auto& loop : loops) {
+        for (auto& [fd, _] : loop.conns) {
+            CLOSE_SOCKET(fd);
+            server.release();
+        }
+        if (loop.wakeFd >= 0) ::close(loop.wakeFd);
+        if (loop.epollFd >= 0) ::close(loop.epollFd);
+    }
+}
+
+void EpollReactor::run(const std::vector<SOCKET>& listeners) {
+    for (SOCKET fd : listeners) SocketUtils::setNonBlocking(fd, true);
+    // With one listener per loop (SO_REUSEPORT) the kernel already spreads
+    // connections; a single shared listener needs EPOLLEXCLUSIVE instead
+    bool shared = listeners.size() < loops.size();
+    std::vector<std::thread> extra;
+    for (size_t i = 1; i < loops.size(); ++i) {
+        extra.emplace_back(&EpollReactor::loopMain, this, i, listeners[i % listeners.size()], shared);
+    }
+    loopMain(0, listeners[0], shared);
+    for (auto& t : extra) t.join();
+}
+
+void EpollReactor::stop() {
+    stopping = true;
+    for (auto& loop : loops) {
+        uint64_t one = 1;
+        if (::write(loop.wakeFd, &one, sizeof(one)) < 0) {
+            LOG_ERROR("event_loop_wake_failed", {"errno", errno});
+        }
+    }
+}
+
+void EpollReactor::loopMain(size_t index, SOCKET listenFd, bool sharedListener) {
+    Loop& loop = loops[index];
+    if (pinThreads) {
+        unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(index % cores, &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+            LOG_ERROR("event_loop_pin_failed", {"loop", index});
+        }
+    }
+
+    epoll_event ev{};
+    ev.events = sharedListener ? (EPOLLIN | EPOLLEXCLUSIVE) : EPOLLIN;
+    ev.data.fd = listenFd;
+    if (epoll_ctl(loop.epollFd, EPOLL_CTL_ADD, listenFd, &ev) != 0) {
+        LOG_ERROR("epoll_ctl_failed", {"errno", errno});
+        return;
+    }
+
+    epoll_event events[kMaxEvents];
+    while (!stopping) {
+        int n = epoll_wait(loop.epollFd, events, kMaxEvents, loop.timers.waitMs(std::chrono::steady_clock::now()));
+        if (n < 0 && errno != EINTR) {
+            LOG_ERROR("epoll_wait_failed", {"errno", errno});
+            break;
+        }
+        loop.now = std::chrono::steady_clock::now();
+        for (int i = 0; i < n; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == loop.wakeFd) continue;
+            if (fd == listenFd) {
+                acceptAll(loop, listenFd);
+                continue;
+            }
+            auto it = loop.conns.find(fd);
+            if (it == loop.conns.end()) continue;
+            Connection& conn = it->second;
+
+            // A hangup can arrive with the request still unread; EPOLLIN
+            // drains it and onReadable closes once it is answered
+            uint32_t flags = events[i].events;
+            bool keep = true;
+            if (flags & EPOLLERR) {
+                keep = false;
+            } else if (flags & EPOLLIN) {
+                keep = onReadable(loop, conn);
+            } else if (flags & EPOLLHUP) {
+                keep = false;
+            } else if (flags & EPOLLOUT) {
+                conn.http.waitingSince = loop.now;  // Room to write means the client is reading
+                keep = onWritable(loop, conn);
+            }
+            if (keep) armTimeout(loop, conn);
+            else closeConnection(loop, fd);
+        }
+        loop.timers.advance(loop.now, [&](TimerWheel::Timer& timer) { expire(loop, static_cast<int>(timer.data)); });
+    }
+    epoll_ctl(loop.epollFd, EPOLL_CTL_DEL, listenFd, nullptr);
+}
+
+void EpollReactor::acceptAll(Loop& loop, SOCKET listenFd) {
+    for (int accepted = 0; accepted < kMaxAcceptBatch; ++accepted) {
+        sockaddr_in addr{};
+        socklen_t len = sizeof(addr);
+        SOCKET fd = accept4(listenFd, reinterpret_cast<sockaddr*>(&addr), &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd == INVALID_SOCKET) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                LOG_ERROR("accept_failed", {"errno", errno});
+            }
+            return;
+        }
+        uint32_t client = ntohl(addr.sin_addr.s_addr);
+        if (server.limitConnection(client)) {
+            server.shed(fd, HttpMetrics::Shed::ClientRate);
+            continue;
+        }
+        if (!server.admit()) {
+            server.shed(fd, HttpMetrics::Shed::Connections);
+            continue;
+        }
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        if (epoll_ctl(loop.epollFd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            CLOSE_SOCKET(fd);
+            server.release();
+            continue;
+        }
+        Connection& conn = loop.conns[fd];
+        conn.fd = fd;
+        conn.http.client = client;
+        conn.timeout.data = static_cast<uint64_t>(fd);
+        armTimeout(loop, conn);
+    }
+}
+
+bool EpollReactor::onReadable(Loop& loop, Connection& conn) {
+    while (true) {
+        size_t avail;
+        char* dst = conn.http.in.prepare(4096, avail);
+        ssize_t bytes = ::recv(conn.fd, dst, avail, 0);
+        if (bytes > 0) {
+            conn.http.in.commit(bytes);
+            if (conn.http.waiting == HttpMetrics::Timeout::Body) conn.http.waitingSince = loop.now;
+            continue;
+        }
+        if (bytes == 0) {
+            // Half-closed after sending: the requests already read still get answers
+            conn.peerClosed = true;
+            break;
+        }
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+        return false;
+    }
+
+    if (conn.state != ConnState::ReadingRequest) return true;
+    return serve(loop, conn);
+}
+
+bool EpollReactor::serve(Loop& loop, Connection& conn) {
+    conn.keepOpen = server.serveBuffered(conn.http);
+    if (conn.http.out.empty()) return !conn.peerClosed;
+
+    conn.state = ConnState::Writing;
+    return onWritable(loop, conn);
+}
+
+bool EpollReactor::onWritable(Loop& loop, Connection& conn) {
+    switch (conn.http.out.flush(conn.fd)) {
+    case ResponseQueue::FlushResult::WouldBlock:
+        setInterest(loop, conn, true);
+        return true;
+    case ResponseQueue::FlushResult::Error:
+        return false;
+    case ResponseQueue::FlushResult::Done:
+        break;
+    }
+
+    if (!conn.keepOpen) return false;
+    conn.state = ConnState::ReadingRequest;
+    setInterest(loop, conn, false);
+    // Requests that arrived while writing would otherwise wait for more input
+    if (!conn.http.in.empty()) return serve(loop, conn);
+    return !conn.peerClosed;
+}
+
+void EpollReactor::setInterest(Loop& loop, Connection& conn, bool write) {
+    if (conn.wantWrite == write) return;
+    epoll_event ev{};
+    ev.events = write ? EPOLLOUT : EPOLLIN;
+    ev.data.fd = conn.fd;
+    epoll_ctl(loop.epollFd, EPOLL_CTL_MOD, conn.fd, &ev);
+    conn.wantWrite = write;
+}
+
+void EpollReactor::closeConnection(Loop& loop, int fd) {
+    epoll_ctl(loop.epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    CLOSE_SOCKET(fd);
+    loop.conns.erase(fd);
+    server.release();
+}
+
+void EpollReactor::armTimeout(Loop& loop, Connection& conn) {
+    loop.timers.schedule(conn.timeout, server.deadline(conn.http, conn.state == ConnState::Writing, loop.now));
+}
+
+void EpollReactor::expire(Loop& loop, int fd) {
+    auto it = loop.conns.find(fd);
+    if (it == loop.conns.end()) return;
+    server.timedOut(it->second.http);
+    closeConnection(loop, fd);
+}
+
+#endif
@@ -0,0 +1,67 @@
+#pragma once
+
+#ifdef __linux__
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <atomic>
+#include <chrono>
+#include "../network/sockets.hpp"
+#include "../util/timer_wheel.hpp"
+#include "http_session.hpp"
+
+class HttpServer;
+
+// Non-blocking event loop built on epoll. Each loop thread owns its own epoll
+// instance and the connections it accepted. Loops either share one listening
+// socket, registered with EPOLLEXCLUSIVE so a new connection wakes only one of
+// them, or each own an SO_REUSEPORT listener. With pinThreads, loop i runs on
+// core i. Requests are handed to HttpServer::serveBuffered inline on the loop
+// thread, and connections stay open between requests unless the client or
+// the keep-alive limits say otherwise. Each connection's current timeout
+// is one timer in its loop's wheel, re-armed after every event it handles.
+class EpollReactor {
+public:
+    EpollReactor(HttpServer& server, size_t loopCount, bool pinThreads = false);
+    ~EpollReactor();
+    void run(const std::vector<SOCKET>& listeners);  // Blocks until stop()
+    void stop();
+private:
+    enum class ConnState { ReadingRequest, Writing };
+
+    struct Connection {
+        SOCKET fd = INVALID_SOCKET;
+        ConnState state = ConnState::ReadingRequest;
+        HttpSession http;
+        bool keepOpen = true;
+        bool wantWrite = false;   // Registered for EPOLLOUT instead of EPOLLIN
+        bool peerClosed = false;  // Read EOF: answer what is buffered, then close
+        TimerWheel::Timer timeout;  // data is the fd
+    };
+
+    struct Loop {
+        int epollFd = -1;
+        int wakeFd = -1;
+        std::unordered_map<int, Connection> conns;
+        TimerWheel timers;
+        std::chrono::steady_clock::time_point now;  // Of the current wakeup
+    };
+
+    void loopMain(size_t index, SOCKET listenFd, bool sharedListener);
+    void acceptAll(Loop& loop, SOCKET listenFd);
+    bool onReadable(Loop& loop, Connection& conn);
+    bool serve(Loop& loop, Connection& conn);
+    bool onWritable(Loop& loop, Connection& conn);
+    void setInterest(Loop& loop, Connection& conn, bool write);
+    void closeConnection(Loop& loop, int fd);
+    void armTimeout(Loop& loop, Connection& conn);
+    void expire(Loop& loop, int fd);
+
+    HttpServer& server;
+    std::vector<Loop> loops;
+    bool pinThreads;
+    std::atomic<bool> stopping{false};
+};
+
+#endif
@@ -0,0 +1,117 @@
+#include "http_body.hpp"
+#include "http_scan.hpp"
+#include <algorithm>
+
+namespace {
+
+int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+}  // namespace
+
+void BodyDecoder::startLength(uint64_t contentLength, uint64_t maxBody) {
+    state = State::Length;
+    remaining = contentLength;
+    limit = maxBody;
+    received = 0;
+    errorCode = contentLength > maxBody ? 413 : 0;
+}
+
+void BodyDecoder::startChunked(uint64_t maxBody) {
+    state = State::ChunkSize;
+    remaining = 0;
+    limit = maxBody;
+    received = 0;
+    trailerBytes = 0;
+    errorCode = 0;
+}
+
+BodyDecoder::Status BodyDecoder::fail(int status) {
+    errorCode = status;
+    return Status::Error;
+}
+
+BodyDecoder::Status BodyDecoder::decode(std::string_view in, size_t& used, BodySink& sink) {
+    used = 0;
+    if (errorCode) return Status::Error;
+
+    while (true) {
+        size_t avail = in.size() - used;
+        switch (state) {
+        case State::Length:
+        case State::ChunkData: {
+            size_t n = static_cast<size_t>(std::min<uint64_t>(remaining, avail));
+            if (n > 0) {
+                sink.onData(in.substr(used, n));
+                used += n;
+                remaining -= n;
+                received += n;
+            }
+            if (remaining > 0) return Status::NeedMore;
+            state = state == State::Length ? State::Done : State::ChunkDataEnd;
+            break;
+        }
+        case State::ChunkDataEnd:
+            // Chunk data is followed by CRLF (bare LF tolerated)
+            if (avail == 0) return Status::NeedMore;
+            if (in[used] == '\r') {
+                if (avail < 2) return Status::NeedMore;
+                if (in[used + 1] != '\n') return fail(400);
+                used += 2;
+            } else if (in[used] == '\n') {
+                used += 1;
+            } else {
+                return fail(400);
+            }
+            state = State::ChunkSize;
+            break;
+        case State::ChunkSize:
+        case State::Trailer: {
+            size_t lf = HttpScan::findByte(in.data() + used, avail, '\n');
+            if (lf == avail) {
+                size_t cap = state == State::ChunkSize ? kMaxLineBytes : kMaxTrailerBytes - trailerBytes;
+                if (avail > cap) return fail(state == State::ChunkSize ? 400 : 431);
+                return Status::NeedMore;
+            }
+            std::string_view line = in.substr(used, lf);
+            if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+            used += lf + 1;
+
+            if (state == State::Trailer) {
+                trailerBytes += lf + 1;
+                if (trailerBytes > kMaxTrailerBytes) return fail(431);
+                if (line.empty()) state = State::Done;  // Trailer fields themselves are ignored
+                break;
+            }
+
+            uint64_t size = 0;
+            size_t digits = 0;
+            for (; digits < line.size(); ++digits) {
+                int v = hexValue(line[digits]);
+                if (v < 0) break;
+                size = size * 16 + v;
+            }
+            if (digits == 0 || digits > 15) return fail(400);
+            // Anything after the size must be whitespace or a chunk extension
+            if (digits < line.size() && line[digits] != ';' && line[digits] != ' ' && line[digits] != '\t') {
+                return fail(400);
+            }
+            if (size == 0) {
+                state = State::Trailer;
+            } else {
+                // Reject as soon as the announced size would exceed the limit
+                if (size > limit - received) return fail(413);
+                remaining = size;
+                state = State::ChunkData;
+            }
+            break;
+        }
+        case State::Done:
+            return Status::Done;
+        }
+    }
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string_view>
+#include <cstddef>
+#include <cstdint>
+
+// Receives decoded request body bytes as they arrive
+class BodySink {
+public:
+    virtual ~BodySink() = default;
+    virtual void onData(std::string_view data) = 0;
+};
+
+// Incremental decoder for a request body framed either by Content-Length or
+// by chunked transfer coding. decode() is fed whatever input is available,
+// hands the body bytes it finds to the sink (as views into that input) and
+// reports how much input it used; unused input, such as a partial chunk-size
+// line, must be offered again on the next call.
+class BodyDecoder {
+public:
+    enum class Status { NeedMore, Done, Error };
+
+    static const size_t kMaxLineBytes = 4096;       // Chunk-size line including extensions
+    static const size_t kMaxTrailerBytes = 16 * 1024;
+
+    void startLength(uint64_t contentLength, uint64_t maxBody);
+    void startChunked(uint64_t maxBody);
+    Status decode(std::string_view in, size_t& used, BodySink& sink);
+    uint64_t bodyBytes() const { return received; }
+    int errorStatus() const { return errorCode; }  // HTTP status for Status::Error
+
+private:
+    enum class State { Length, ChunkSize, ChunkData, ChunkDataEnd, Trailer, Done };
+
+    Status fail(int status);
+
+    State state = State::Done;
+    uint64_t remaining = 0;
+    uint64_t limit = 0;
+    uint64_t received = 0;
+    size_t trailerBytes = 0;
+    int errorCode = 0;
+};
@@ -0,0 +1,94 @@
+#include "http_metrics.hpp"
+#include "http_router.hpp"
+#include <utility>
+
+namespace {
+
+const char* const kMethodNames[] = {"GET", "POST", "other"};
+const char* const kRouteNames[] = {"/", "/style.css", "/app.js", "/favicon.ico", "/messages", "/messages/:id",
+                                   "/messages/import", "/peers", "/clear", "/metrics", "/debug/traces", "other", "invalid"};
+const char* const kShedReasons[] = {"reason=\"connections\"", "reason=\"queue\"", "reason=\"client_rate\""};
+const char* const kTimeoutPhases[] = {"phase=\"header\"", "phase=\"body\"", "phase=\"idle\"", "phase=\"send\""};
+
+size_t codeSlot(int code) {
+    size_t i = 0;
+    while (i < HttpMetrics::kCodeSlots - 1 && HttpMetrics::kCodes[i] != code) ++i;
+    return i;
+}
+
+}  // namespace
+
+HttpMetrics& HttpMetrics::instance() {
+    static HttpMetrics metrics;
+    return metrics;
+}
+
+HttpMetrics::Method HttpMetrics::methodOf(std::string_view method) {
+    if (method == "GET") return Method::Get;
+    if (method == "POST") return Method::Post;
+    return Method::Other;
+}
+
+HttpMetrics::Route HttpMetrics::routeOf(std::string_view path) {
+    return HttpRouter::match(Method::Other, path).route;
+}
+
+void HttpMetrics::countRequest(Method method, Route route, int code) {
+    size_t slot = (static_cast<size_t>(method) * kRoutes + static_cast<size_t>(route)) * kCodeSlots + codeSlot(code);
+    requests.add(slot);
+}
+
+void HttpMetrics::render(std::string& out) const {
+    Metrics::writeHeader(out, "lanchat_http_requests_total", "counter", "Requests answered, by method, route and status.");
+    std::string labels;
+    for (size_t m = 0; m < kMethods; ++m) {
+        for (size_t r = 0; r < kRoutes; ++r) {
+            for (size_t c = 0; c < kCodeSlots; ++c) {
+                uint64_t n = requests.value((m * kRoutes + r) * kCodeSlots + c);
+                if (n == 0) continue;
+                labels = "method=\"";
+                labels += kMethodNames[m];
+                labels += "\",route=\"";
+                labels += kRouteNames[r];
+                labels += "\",code=\"";
+                labels += c < kCodeSlots - 1 ? std::to_string(kCodes[c]) : "other";
+                labels += '"';
+                Metrics::writeSample(out, "lanchat_http_requests_total", labels, n);
+            }
+        }
+    }
+
+    uint64_t opened = connections.value(0);
+    uint64_t closed = connections.value(1);
+    Metrics::writeHeader(out, "lanchat_http_connections_opened_total", "counter", "Connections accepted.");
+    Metrics::writeSample(out, "lanchat_http_connections_opened_total", "", opened);
+    Metrics::writeHeader(out, "lanchat_http_connections", "gauge", "Connections currently open.");
+    Metrics::writeSample(out, "lanchat_http_connections", "", opened >= closed ? opened - closed : 0);
+    Metrics::writeHeader(out, "lanchat_http_shed_total", "counter",
+                         "Connections answered with 503 or 429 without reading the request, by the limit they hit.");
+    for (size_t i = 0; i < static_cast<size_t>(Shed::Count); ++i) {
+        Metrics::writeSample(out, "lanchat_http_shed_total", kShedReasons[i], shed.value(i));
+    }
+    Metrics::writeHeader(out, "lanchat_http_timeouts_total", "counter",
+                         "Connections closed because a deadline passed, by what they were waiting for.");
+    for (size_t i = 0; i < static_cast<size_t>(Timeout::Count); ++i) {
+        Metrics::writeSample(out, "lanchat_http_timeouts_total", kTimeoutPhases[i], timeouts.value(i));
+    }
+
+    Metrics::writeHeader(out, "lanchat_http_phase_seconds", "histogram",
+                         "Time spent per request parsing, handling, serializing and sending.");
+    const std::pair<const char*, const Metrics::Histogram*> phases[] = {
+        {"phase=\"parse\"", &parse}, {"phase=\"handle\"", &handle},
+        {"phase=\"serialize\"", &serialize}, {"phase=\"send\"", &send}};
+    Metrics::Histogram::Snapshot snapshots[4];
+    for (size_t i = 0; i < 4; ++i) {
+        snapshots[i] = phases[i].second->snapshot();
+        Metrics::writeHistogram(out, "lanchat_http_phase_seconds", phases[i].first, snapshots[i]);
+    }
+    // Quantiles at full bucket resolution, which the exported buckets coarsen
+    Metrics::writeHeader(out, "lanchat_http_phase_quantile_seconds", "gauge",
+                         "Latency quantiles per phase, to within 12.5%.");
+    for (size_t i = 0; i < 4; ++i) {
+        Metrics::writeQuantiles(out, "lanchat_http_phase_quantile_seconds", phases[i].first, snapshots[i]);
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include "../util/metrics.hpp"
+
+// Request metrics shared by every I/O engine, rendered by GET /metrics.
+// Routes and status codes map onto fixed tables so arbitrary paths cannot
+// grow the label set.
+class HttpMetrics {
+public:
+    enum class Method { Get, Post, Other, Count };
+    enum class Route {
+        Index, Style, Script, Favicon, Messages, Message, Import, Peers, Clear, Metrics, Traces, Other, Invalid, Count
+    };
+    static constexpr int kCodes[] = {200, 204, 400, 404, 405, 413, 429, 431, 500, 501};
+    static const size_t kCodeSlots = sizeof(kCodes) / sizeof(kCodes[0]) + 1;  // Last one is "other"
+    // Why a connection was turned away before its request was read: 503s
+    // from admission control, or a 429 for a client connecting too fast
+    enum class Shed { Connections, Queue, ClientRate, Count };
+    // What a connection was waiting for when its deadline passed
+    enum class Timeout { Header, Body, Idle, Send, Count };
+
+    static HttpMetrics& instance();
+
+    static Method methodOf(std::string_view method);
+    // The route table's label for path (HttpRouter), whatever the method
+    static Route routeOf(std::string_view path);
+
+    void countRequest(Method method, Route route, int code);
+    void connectionOpened() { connections.add(0); }
+    void connectionClosed() { connections.add(1); }
+    void countShed(Shed reason) { shed.add(static_cast<size_t>(reason)); }
+    void countTimeout(Timeout phase) { timeouts.add(static_cast<size_t>(phase)); }
+
+    // Per-request phases
+    Metrics::Histogram parse;
+    Metrics::Histogram handle;
+    Metrics::Histogram serialize;
+    Metrics::Histogram send;  // From queueing a response to its last byte leaving
+
+    void render(std::string& out) const;
+
+private:
+    static const size_t kMethods = static_cast<size_t>(Method::Count);
+    static const size_t kRoutes = static_cast<size_t>(Route::Count);
+
+    Metrics::CounterSet<kMethods * kRoutes * kCodeSlots> requests;
+    Metrics::CounterSet<2> connections;  // Opened, closed
+    Metrics::CounterSet<static_cast<size_t>(Shed::Count)> shed;
+    Metrics::CounterSet<static_cast<size_t>(Timeout::Count)> timeouts;
+};
@@ -0,0 +1,253 @@
+#include "http_parser.hpp"
+#include "http_scan.hpp"
+#include <cstring>
+
+namespace {
+
+bool iequals(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        char x = a[i], y = b[i];
+        if (x >= 'A' && x <= 'Z') x += 'a' - 'A';
+        if (y >= 'A' && y <= 'Z') y += 'a' - 'A';
+        if (x != y) return false;
+    }
+    return true;
+}
+
+struct TokenTable {
+    bool allowed[256] = {};
+    constexpr TokenTable() {
+        for (int c = 'a'; c <= 'z'; ++c) allowed[c] = true;
+        for (int c = 'A'; c <= 'Z'; ++c) allowed[c] = true;
+        for (int c = '0'; c <= '9'; ++c) allowed[c] = true;
+        for (char c : {'!', '#', '$', '%', '&', '\'', '*', '+', '-', '.', '^', '_', '`', '|', '~'}) {
+            allowed[static_cast<unsigned char>(c)] = true;
+        }
+    }
+};
+constexpr TokenTable kTokenChars;
+
+bool isTokenChar(char c) {
+    return kTokenChars.allowed[static_cast<unsigned char>(c)];
+}
+
+std::string_view trimOws(std::string_view s, size_t& lead) {
+    lead = 0;
+    while (lead < s.size() && (s[lead] == ' ' || s[lead] == '\t')) ++lead;
+    size_t end = s.size();
+    while (end > lead && (s[end - 1] == ' ' || s[end - 1] == '\t')) --end;
+    return s.substr(lead, end - lead);
+}
+
+}  // namespace
+
+std::string_view HttpRequest::header(std::string_view name) const {
+    for (size_t i = 0; i < headerCount; ++i) {
+        if (iequals(headers[i].name, name)) return headers[i].value;
+    }
+    return {};
+}
+
+void HttpParser::reset() {
+    state = State::RequestLine;
+    scanPos = lineStart = bodyStart = bodyScan = bodyEnd = 0;
+    headerCount = 0;
+    contentLength = 0;
+    sawContentLength = false;
+    chunked = false;
+    errorCode = 0;
+    chunkedBody.data.clear();  // Keeps its capacity for the next request
+    req.headerCount = 0;
+    req.contentLength = 0;
+    req.chunked = false;
+    req.body = {};
+}
+
+HttpParser::Status HttpParser::fail(int status) {
+    errorCode = status;
+    return Status::Error;
+}
+
+HttpParser::Status HttpParser::parse(std::string_view buf) {
+    if (state == State::Done) return Status::Complete;
+    if (errorCode) return Status::Error;
+    if (state == State::Body) return parseBody(buf);
+
+    while (state != State::Body) {
+        // Lines are only split once the whole header block is buffered. The
+        // terminator search resumes where the last call stopped, backing up
+        // two bytes in case the blank line straddles the chunk boundary.
+        size_t from = scanPos > lineStart + 2 ? scanPos - 2 : lineStart;
+        size_t end = HttpScan::findHeaderEnd(buf.data() + from, buf.size() - from);
+        if (end == 0) {
+            scanPos = buf.size();
+            if (scanPos > kMaxHeaderBytes) return fail(431);
+            return Status::Incomplete;
+        }
+        size_t headerEnd = from + end;
+        if (headerEnd > kMaxHeaderBytes) return fail(431);
+
+        while (lineStart < headerEnd && state != State::Body) {
+            size_t lineEnd = lineStart + HttpScan::findByte(buf.data() + lineStart, headerEnd - lineStart, '\n');
+            // Accept bare LF as well as CRLF
+            size_t stop = (lineEnd > lineStart && buf[lineEnd - 1] == '\r') ? lineEnd - 1 : lineEnd;
+            std::string_view line = buf.substr(lineStart, stop - lineStart);
+            size_t off = lineStart;
+            lineStart = lineEnd + 1;
+
+            if (state == State::RequestLine) {
+                if (line.empty()) continue;  // Tolerate stray CRLF between pipelined requests
+                if (!parseRequestLine(line, off)) return fail(400);
+                state = State::Headers;
+            } else if (line.empty()) {
+                bodyStart = bodyScan = lineStart;
+                state = State::Body;
+            } else if (!parseHeaderLine(line, off)) {
+                return Status::Error;
+            }
+        }
+        // Only stray blank lines so far: look for the next terminator
+        scanPos = lineStart;
+    }
+
+    // A length and a transfer coding together are a request smuggling vector
+    if (chunked && sawContentLength) return fail(400);
+    if (!chunked && contentLength == 0) {
+        bodyEnd = bodyStart;
+        state = State::Done;
+        materialize(buf, true);
+        return Status::Complete;
+    }
+    materialize(buf, false);
+    return Status::HeadersComplete;
+}
+
+HttpParser::Status HttpParser::parseBody(std::string_view buf) {
+    if (!chunked) {
+        if (contentLength > maxBodySize) return fail(413);
+        if (buf.size() - bodyStart < contentLength) return Status::Incomplete;
+        bodyEnd = bodyStart + contentLength;
+    } else {
+        if (bodyScan == bodyStart) chunkDecoder.startChunked(maxBodySize);
+        size_t used = 0;
+        auto status = chunkDecoder.decode(buf.substr(bodyScan), used, chunkedBody);
+        bodyScan += used;
+        if (status == BodyDecoder::Status::Error) return fail(chunkDecoder.errorStatus());
+        if (status == BodyDecoder::Status::NeedMore) return Status::Incomplete;
+        bodyEnd = bodyScan;
+    }
+    state = State::Done;
+    materialize(buf, true);
+    return Status::Complete;
+}
+
+bool HttpParser::parseRequestLine(std::string_view line, size_t lineOff) {
+    size_t sp1 = line.find(' ');
+    if (sp1 == std::string_view::npos || sp1 == 0) return false;
+    size_t sp2 = line.find(' ', sp1 + 1);
+    size_t targetEnd = sp2 == std::string_view::npos ? line.size() : sp2;
+    if (targetEnd == sp1 + 1) return false;
+
+    for (size_t i = 0; i < sp1; ++i) {
+        if (!isTokenChar(line[i])) return false;
+    }
+    method = {static_cast<uint32_t>(lineOff), static_cast<uint32_t>(sp1)};
+
+    std::string_view target = line.substr(sp1 + 1, targetEnd - sp1 - 1);
+    size_t q = target.find('?');
+    size_t targetOff = lineOff + sp1 + 1;
+    if (q == std::string_view::npos) {
+        path = {static_cast<uint32_t>(targetOff), static_cast<uint32_t>(target.size())};
+        query = {};
+    } else {
+        path = {static_cast<uint32_t>(targetOff), static_cast<uint32_t>(q)};
+        query = {static_cast<uint32_t>(targetOff + q + 1), static_cast<uint32_t>(target.size() - q - 1)};
+    }
+
+    if (sp2 == std::string_view::npos) {
+        version = {};  // HTTP/0.9 style request line
+    } else {
+        std::string_view v = line.substr(sp2 + 1);
+        if (v.size() != 8 || v.compare(0, 5, "HTTP/") != 0) return false;
+        version = {static_cast<uint32_t>(lineOff + sp2 + 1), 8};
+    }
+    return true;
+}
+
+bool HttpParser::parseHeaderLine(std::string_view line, size_t lineOff) {
+    // Split on the first ':' only, so values such as "Host: x:8080" survive
+    size_t colon = HttpScan::findByte(line.data(), line.size(), ':');
+    if (colon == line.size() || colon == 0) {
+        errorCode = 400;
+        return false;
+    }
+    for (size_t i = 0; i < colon; ++i) {
+        if (!isTokenChar(line[i])) {
+            errorCode = 400;
+            return false;
+        }
+    }
+    if (headerCount == HttpRequest::kMaxHeaders) {
+        errorCode = 431;
+        return false;
+    }
+
+    size_t lead = 0;
+    std::string_view value = trimOws(line.substr(colon + 1), lead);
+    std::string_view name = line.substr(0, colon);
+    HeaderSpan& h = headerSpans[headerCount++];
+    h.name = {static_cast<uint32_t>(lineOff), static_cast<uint32_t>(colon)};
+    h.value = {static_cast<uint32_t>(lineOff + colon + 1 + lead), static_cast<uint32_t>(value.size())};
+
+    if (iequals(name, "Content-Length")) {
+        if (value.empty() || value.size() > 18) {
+            errorCode = 400;
+            return false;
+        }
+        size_t len = 0;
+        for (char c : value) {
+            if (c < '0' || c > '9') {
+                errorCode = 400;
+                return false;
+            }
+            len = len * 10 + (c - '0');
+        }
+        // Conflicting lengths are a request smuggling vector
+        if (sawContentLength && len != contentLength) {
+            errorCode = 400;
+            return false;
+        }
+        contentLength = len;
+        sawContentLength = true;
+    } else if (iequals(name, "Transfer-Encoding")) {
+        // Only a lone "chunked" is understood; other codings can't be framed
+        if (!iequals(value, "chunked") || chunked) {
+            errorCode = 501;
+            return false;
+        }
+        chunked = true;
+    }
+    return true;
+}
+
+void HttpParser::materialize(std::string_view buf, bool withBody) {
+    auto view = [&buf](const Span& s) { return buf.substr(s.off, s.len); };
+    req.method = view(method);
+    req.path = view(path);
+    req.query = view(query);
+    req.version = view(version);
+    if (!withBody) {
+        req.body = {};
+    } else if (chunked) {
+        req.body = chunkedBody.data;
+    } else {
+        req.body = buf.substr(bodyStart, contentLength);
+    }
+    req.contentLength = withBody ? req.body.size() : contentLength;
+    req.chunked = chunked;
+    req.headerCount = headerCount;
+    for (size_t i = 0; i < headerCount; ++i) {
+        req.headers[i] = {view(headerSpans[i].name), view(headerSpans[i].value)};
+    }
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <cstddef>
+#include <cstdint>
+#include "http_body.hpp"
+
+struct HttpHeader {
+    std::string_view name;
+    std::string_view value;
+};
+
+// A parsed request. Every field is a view into the receive buffer the parser
+// was given, so it stays valid only until that buffer is modified.
+struct HttpRequest {
+    static const size_t kMaxHeaders = 64;
+
+    std::string_view method;
+    std::string_view path;
+    std::string_view query;
+    std::string_view version;
+    std::string_view body;  // Decoded; for chunked requests it points into the parser
+    HttpHeader headers[kMaxHeaders];
+    size_t headerCount = 0;
+    size_t contentLength = 0;  // Length of body; the declared length at HeadersComplete
+    bool chunked = false;
+
+    std::string_view header(std::string_view name) const;  // Case-insensitive, empty if absent
+};
+
+// Incremental HTTP/1.x request parser. parse() is called with everything
+// buffered so far for the current request; it resumes scanning where the
+// previous call stopped, and only records offsets, so the buffer may be
+// reallocated between calls. Nothing is allocated, except that chunked
+// bodies are decoded into a buffer the parser keeps between requests.
+//
+// When a request has a body, parse() returns HeadersComplete once, with the
+// headers available from request(). The caller then either keeps calling
+// parse() to buffer the body (limited to maxBodySize, with 413 reported as
+// soon as the length is known to be too large), or takes the body over
+// itself from bodyOffset() with a BodyDecoder.
+class HttpParser {
+public:
+    enum class Status { Incomplete, HeadersComplete, Complete, Error };
+
+    static const size_t kMaxHeaderBytes = 64 * 1024;
+
+    Status parse(std::string_view buf);
+    const HttpRequest& request() const { return req; }
+    size_t bodyOffset() const { return bodyStart; }  // Valid from HeadersComplete
+    size_t consumed() const { return bodyEnd; }      // Valid once Complete
+    int errorStatus() const { return errorCode; }  // HTTP status for Status::Error
+    bool readingBody() const { return state == State::Body; }  // Headers done, buffered body incomplete
+    void setMaxBodySize(uint64_t bytes) { maxBodySize = bytes; }
+    void reset();
+
+private:
+    enum class State { RequestLine, Headers, Body, Done };
+    struct Span {
+        uint32_t off = 0;
+        uint32_t len = 0;
+    };
+    struct HeaderSpan {
+        Span name;
+        Span value;
+    };
+
+    // Collects a buffered chunked body
+    struct ChunkedBody : BodySink {
+        std::string data;
+        void onData(std::string_view piece) override { data.append(piece); }
+    };
+
+    Status fail(int status);
+    Status parseBody(std::string_view buf);
+    bool parseRequestLine(std::string_view line, size_t lineOff);
+    bool parseHeaderLine(std::string_view line, size_t lineOff);
+    void materialize(std::string_view buf, bool withBody);
+
+    State state = State::RequestLine;
+    size_t scanPos = 0;    // Where the header terminator search resumes
+    size_t lineStart = 0;
+    size_t bodyStart = 0;
+    size_t bodyScan = 0;   // Where chunked decoding resumes
+    size_t bodyEnd = 0;
+    uint64_t maxBodySize = 1024 * 1024;
+    Span method, path, query, version;
+    HeaderSpan headerSpans[HttpRequest::kMaxHeaders];
+    size_t headerCount = 0;
+    size_t contentLength = 0;
+    bool sawContentLength = false;
+    bool chunked = false;
+    int errorCode = 0;
+    BodyDecoder chunkDecoder;
+    ChunkedBody chunkedBody;
+    HttpRequest req;
+};
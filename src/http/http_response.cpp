@@ -0,0 +1,341 @@
+#include "http_response.hpp"
+#include "http_metrics.hpp"
+#include "../util/trace.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+namespace {
+const size_t kMaxIov = 64;
+const size_t kFileChunk = 64 * 1024;
+}
+
+namespace {
+
+#ifdef _WIN32
+using FileStat = struct _stat64;
+int statPath(const char* path, FileStat* st) { return _stat64(path, st); }
+int64_t mtimeOf(const FileStat& st) { return static_cast<int64_t>(st.st_mtime) * 1000000000; }
+bool isRegular(const FileStat& st) { return (st.st_mode & _S_IFREG) != 0; }
+#else
+using FileStat = struct stat;
+int statPath(const char* path, FileStat* st) { return ::stat(path, st); }
+#ifdef __APPLE__
+int64_t mtimeOf(const FileStat& st) { return static_cast<int64_t>(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec; }
+#else
+int64_t mtimeOf(const FileStat& st) { return static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec; }
+#endif
+bool isRegular(const FileStat& st) { return S_ISREG(st.st_mode); }
+#endif
+
+}  // namespace
+
+std::shared_ptr<const FileHandle> FileHandle::open(const char* path) {
+#ifdef _WIN32
+    int fd = _open(path, _O_RDONLY | _O_BINARY);
+    if (fd < 0) return nullptr;
+    FileStat st;
+    if (_fstat64(fd, &st) != 0 || !isRegular(st)) {
+        _close(fd);
+        return nullptr;
+    }
+#else
+    int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return nullptr;
+    FileStat st;
+    if (fstat(fd, &st) != 0 || !isRegular(st)) {
+        ::close(fd);
+        return nullptr;
+    }
+#endif
+    return std::shared_ptr<const FileHandle>(new FileHandle(fd, static_cast<uint64_t>(st.st_size), mtimeOf(st),
+                                                            static_cast<uint64_t>(st.st_ino)));
+}
+
+bool FileHandle::matches(const char* path) const {
+    FileStat st;
+    return statPath(path, &st) == 0 && static_cast<uint64_t>(st.st_size) == fileSize &&
+           mtimeOf(st) == modified && static_cast<uint64_t>(st.st_ino) == inode;
+}
+
+FileHandle::~FileHandle() {
+#ifdef _WIN32
+    _close(handle);
+#else
+    ::close(handle);
+#endif
+}
+
+long long FileHandle::readAt(char* buf, size_t len, uint64_t offset) const {
+#ifdef _WIN32
+    if (_lseeki64(handle, static_cast<long long>(offset), SEEK_SET) < 0) return -1;
+    return _read(handle, buf, static_cast<unsigned>(len));
+#else
+    return pread(handle, buf, len, static_cast<off_t>(offset));
+#endif
+}
+
+uint64_t HttpResponse::bodySize() const {
+    uint64_t total = 0;
+    for (const auto& seg : body) total += seg.length;
+    return total;
+}
+
+void HttpResponse::setBody(std::string_view data) {
+    body.clear();
+    if (data.empty()) return;
+    body.emplace_back(std::pmr::string(data, body.get_allocator()));
+}
+
+void HttpResponse::appendBody(std::pmr::string data) {
+    if (data.empty()) return;
+    body.emplace_back(std::move(data));
+}
+
+void HttpResponse::appendBody(std::shared_ptr<const std::string> buf) {
+    if (!buf || buf->empty()) return;
+    BodySegment seg;
+    seg.length = buf->size();
+    seg.shared = std::move(buf);
+    body.push_back(std::move(seg));
+}
+
+void HttpResponse::appendFile(std::shared_ptr<const FileHandle> file, uint64_t offset, uint64_t length) {
+    if (!file || length == 0) return;
+    BodySegment seg(std::pmr::string(body.get_allocator()));  // io_uring may load the range into owned
+    seg.file = std::move(file);
+    seg.offset = offset;
+    seg.length = length;
+    body.push_back(std::move(seg));
+}
+
+bool HttpResponse::streamed() const {
+    for (const auto& seg : body) {
+        if (seg.isStream()) return true;
+    }
+    return false;
+}
+
+void HttpResponse::appendStream(std::shared_ptr<BodyStream> stream) {
+    if (!stream) return;
+    BodySegment seg;
+    seg.stream = std::move(stream);
+    body.push_back(std::move(seg));
+}
+
+void ResponseQueue::push(HttpResponse&& response) {
+    if (empty()) {
+        queuedAt = std::chrono::steady_clock::now();
+        queuedRequest = Trace::currentRequest();
+    }
+    pushSegment(BodySegment(std::move(response.head)));
+    for (auto& seg : response.body) {
+        seg.chunked = seg.isStream() && response.chunked;
+        pushSegment(std::move(seg));
+    }
+    response.body.clear();
+}
+
+void ResponseQueue::clear() {
+    segments.clear();
+    first = 0;
+    responseArena.reset();
+}
+
+void ResponseQueue::pushSegment(BodySegment&& seg) {
+    // Every queued segment has bytes ready; streams stage their first piece now
+    if (seg.isStream() && !refill(seg)) return;
+    if (seg.length > 0) segments.push_back(std::move(seg));
+}
+
+bool ResponseQueue::refill(BodySegment& seg) {
+    if (!seg.stream) return false;
+    if (!seg.staging) seg.staging = BufferPool::acquire(kStreamChunk);
+    char* buf = seg.staging.data();
+    size_t cap = seg.staging.capacity();
+    if (!seg.chunked) {
+        size_t n = seg.stream->read(buf, cap);
+        seg.offset = 0;
+        seg.length = n;
+        if (n == 0) {
+            seg.stream.reset();
+            seg.staging.reset();
+        }
+        return n > 0;
+    }
+
+    // Read behind room for the chunk-size line, then frame the piece in place
+    const size_t kPrefix = 18;  // Up to 16 hex digits and CRLF
+    size_t n = seg.stream->read(buf + kPrefix, cap - kPrefix - 2);
+    if (n == 0) {
+        std::memcpy(buf, "0\r\n\r\n", 5);
+        seg.offset = 0;
+        seg.length = 5;
+        seg.stream.reset();  // Plain segment from here on
+        return true;
+    }
+    size_t pos = kPrefix - 2;
+    buf[pos] = '\r';
+    buf[pos + 1] = '\n';
+    for (size_t v = n; v > 0; v >>= 4) buf[--pos] = "0123456789abcdef"[v & 0xf];
+    std::memcpy(buf + kPrefix + n, "\r\n", 2);
+    seg.offset = pos;
+    seg.length = (kPrefix - pos) + n + 2;
+    return true;
+}
+
+uint64_t ResponseQueue::pendingBytes() const {
+    uint64_t total = 0;
+    for (size_t i = first; i < segments.size(); ++i) total += segments[i].length;
+    return total;
+}
+
+ResponseQueue::FlushResult ResponseQueue::flush(SOCKET s) {
+    FlushResult result = FlushResult::Done;
+    while (!empty()) {
+        if (segments[first].isFile()) {
+            if (!sendFileSegment(s, segments[first], result)) return result;
+            continue;
+        }
+
+        // Gather consecutive in-memory segments into one vectored send
+#ifdef _WIN32
+        WSABUF bufs[kMaxIov];
+        DWORD count = 0;
+        for (auto it = segments.begin() + first; it != segments.end() && count < kMaxIov && !it->isFile(); ++it) {
+            bufs[count].buf = const_cast<char*>(it->data());
+            bufs[count].len = static_cast<ULONG>(it->length);
+            ++count;
+            if (it->isStream()) break;  // Its next piece is staged once this one is sent
+        }
+        DWORD sent = 0;
+        if (WSASend(s, bufs, count, &sent, 0, nullptr, nullptr) != 0) {
+            return WSAGetLastError() == WSAEWOULDBLOCK ? FlushResult::WouldBlock : FlushResult::Error;
+        }
+#else
+        iovec iov[kMaxIov];
+        size_t count = 0;
+        for (auto it = segments.begin() + first; it != segments.end() && count < kMaxIov && !it->isFile(); ++it) {
+            iov[count].iov_base = const_cast<char*>(it->data());
+            iov[count].iov_len = it->length;
+            ++count;
+            if (it->isStream()) break;  // Its next piece is staged once this one is sent
+        }
+        msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+        int flags = MSG_NOSIGNAL;
+#ifdef MSG_MORE
+        // A file range follows: let the kernel merge the headers with it instead
+        // of sending a short segment that Nagle then holds behind a delayed ACK
+        if (first + count < segments.size() && segments[first + count].isFile()) flags |= MSG_MORE;
+#endif
+        ssize_t sent = sendmsg(s, &msg, flags);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? FlushResult::WouldBlock : FlushResult::Error;
+        }
+#endif
+        consumeFront(static_cast<uint64_t>(sent));
+    }
+    return FlushResult::Done;
+}
+
+bool ResponseQueue::sendFileSegment(SOCKET s, BodySegment& seg, FlushResult& result) {
+#ifdef __linux__
+    off_t off = static_cast<off_t>(seg.offset);
+    ssize_t n = sendfile(s, seg.file->fd(), &off, std::min<uint64_t>(seg.length, 1u << 30));
+    if (n > 0) {
+        consumeFront(static_cast<uint64_t>(n));
+        return true;
+    }
+    if (n < 0 && errno == EINTR) return true;
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        result = FlushResult::WouldBlock;
+        return false;
+    }
+    if (n == 0) {
+        // File shrank underneath us; the promised Content-Length can't be met
+        result = FlushResult::Error;
+        return false;
+    }
+    // sendfile unsupported for this pair of descriptors: copy through user space
+#endif
+    char buf[kFileChunk];
+    long long got = seg.file->readAt(buf, std::min<uint64_t>(seg.length, sizeof(buf)), seg.offset);
+    if (got <= 0) {
+        result = FlushResult::Error;
+        return false;
+    }
+    while (true) {
+        auto sent = ::send(s, buf, static_cast<int>(got), MSG_NOSIGNAL);
+        if (sent >= 0) {
+            // Anything unsent is simply re-read on the next call
+            consumeFront(static_cast<uint64_t>(sent));
+            return true;
+        }
+#ifdef _WIN32
+        result = WSAGetLastError() == WSAEWOULDBLOCK ? FlushResult::WouldBlock : FlushResult::Error;
+#else
+        if (errno == EINTR) continue;
+        result = (errno == EAGAIN || errno == EWOULDBLOCK) ? FlushResult::WouldBlock : FlushResult::Error;
+#endif
+        return false;
+    }
+}
+
+void ResponseQueue::consumeFront(uint64_t bytes) {
+    while (bytes > 0 && !empty()) {
+        BodySegment& seg = segments[first];
+        uint64_t take = std::min(bytes, seg.length);
+        seg.offset += take;
+        seg.length -= take;
+        bytes -= take;
+        if (seg.length == 0 && !refill(seg)) ++first;
+    }
+    // Once everything is out, nothing references the arena any more
+    if (empty()) {
+        auto sent = std::chrono::steady_clock::now();
+        HttpMetrics::instance().send.record(sent - queuedAt);
+        Trace::record("send", queuedAt, sent, queuedRequest);
+        clear();
+    }
+}
+
+#ifndef _WIN32
+size_t ResponseQueue::gather(iovec* iov, size_t maxIov) {
+    size_t count = 0;
+    for (auto it = segments.begin() + first; it != segments.end() && count < maxIov; ++it) {
+        if (it->isFile()) {
+            it->owned.resize(it->length);
+            long long got = it->file->readAt(&it->owned[0], it->owned.size(), it->offset);
+            if (got != static_cast<long long>(it->owned.size())) break;
+            it->file.reset();
+            it->offset = 0;
+        }
+        iov[count].iov_base = const_cast<char*>(it->data());
+        iov[count].iov_len = it->length;
+        ++count;
+        if (it->isStream()) break;
+    }
+    return count;
+}
+
+void ResponseQueue::consume(uint64_t bytes) {
+    consumeFront(bytes);
+}
+#endif
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <memory_resource>
+#include <cstdint>
+#include <chrono>
+#include "../network/sockets.hpp"
+#include "../util/request_arena.hpp"
+#include "../util/buffer_pool.hpp"
+
+#ifndef _WIN32
+#include <sys/uio.h>
+#endif
+
+// Read-only file kept open so a response can send a range of it without
+// copying it into user space first (sendfile on Linux).
+class FileHandle {
+public:
+    static std::shared_ptr<const FileHandle> open(const char* path);
+    ~FileHandle();
+    int fd() const { return handle; }
+    uint64_t size() const { return fileSize; }
+    // True while path still names this file with the same size and mtime
+    bool matches(const char* path) const;
+    // Reads up to len bytes at offset; returns bytes read or -1
+    long long readAt(char* buf, size_t len, uint64_t offset) const;
+private:
+    FileHandle(int fd, uint64_t size, int64_t mtime, uint64_t ino)
+        : handle(fd), fileSize(size), modified(mtime), inode(ino) {}
+    int handle;
+    uint64_t fileSize;
+    int64_t modified;  // Nanoseconds where the platform provides them
+    uint64_t inode;
+};
+
+// Produces a response body on demand, for bodies too large to build before
+// sending starts. read() runs on the connection's I/O thread each time the
+// previous piece has been written, and must not throw.
+class BodyStream {
+public:
+    virtual ~BodyStream() = default;
+    // Writes up to cap bytes into buf and returns how many; 0 ends the body
+    virtual size_t read(char* buf, size_t cap) = 0;
+};
+
+// One piece of outgoing data: bytes owned by the segment, a slice of a
+// shared immutable buffer (e.g. cached serialized JSON), a file range, or a
+// stream pulled into a fixed staging buffer as the socket drains.
+struct BodySegment {
+    BodySegment() = default;
+    // Takes over data together with its allocator (no copy for arena strings)
+    explicit BodySegment(std::pmr::string data) : owned(std::move(data)), length(owned.size()) {}
+
+    std::pmr::string owned;
+    std::shared_ptr<const std::string> shared;
+    std::shared_ptr<const FileHandle> file;
+    std::shared_ptr<BodyStream> stream;
+    BufferPool::Buffer staging;  // Current piece of the stream
+    bool chunked = false;        // Frame the stream with chunked transfer coding
+    uint64_t offset = 0;
+    uint64_t length = 0;         // Bytes left to send (staged bytes for a stream)
+
+    bool isFile() const { return file != nullptr; }
+    bool isStream() const { return stream != nullptr; }
+    const char* data() const {
+        if (staging) return staging.data() + offset;
+        return (shared ? shared->data() : owned.data()) + offset;
+    }
+};
+
+// Allocates from the arena of the request being handled (RequestArena::current)
+// unless given another resource.
+struct HttpResponse {
+    HttpResponse() : HttpResponse(RequestArena::current()) {}
+    explicit HttpResponse(std::pmr::memory_resource* mr) : head(mr), body(mr) {}
+
+    int code = 200;
+    std::string_view contentType = "text/plain";  // Must outlive the response; normally a literal
+    std::pmr::string head;  // Status line and headers, filled in by HttpServer::serializeResponse
+    std::pmr::vector<BodySegment> body;
+    bool chunked = false;  // Streamed body framed with chunked coding; set by HttpServer
+    uint32_t retryAfter = 0;  // Seconds; sent as Retry-After when set
+    std::string_view allow;   // Allow header for a 405; must outlive the response
+
+    std::pmr::memory_resource* resource() const { return body.get_allocator().resource(); }
+    uint64_t bodySize() const;
+    bool streamed() const;
+    void setBody(std::string_view data);
+    void appendBody(std::shared_ptr<const std::string> buf);
+    void appendBody(std::pmr::string data);  // Build it with resource() to avoid a copy
+    void appendFile(std::shared_ptr<const FileHandle> file, uint64_t offset, uint64_t length);
+    void appendStream(std::shared_ptr<BodyStream> stream);  // Length unknown up front
+};
+
+// Per-connection queue of serialized responses, written with scatter-gather
+// I/O. Short writes leave the queue positioned at the first unsent byte. The
+// queue owns the connection's RequestArena and resets it whenever everything
+// queued has been sent.
+class ResponseQueue {
+public:
+    enum class FlushResult { Done, WouldBlock, Error };
+
+    void push(HttpResponse&& response);
+    bool empty() const { return first == segments.size(); }
+    uint64_t pendingBytes() const;
+    void clear();
+    RequestArena& arena() { return responseArena; }
+
+    // Writes until the queue is empty, the socket would block or an error
+    // occurs. On a blocking socket it only returns Done or Error.
+    FlushResult flush(SOCKET s);
+
+#ifndef _WIN32
+    // For engines that submit the write themselves (io_uring): fills iov with
+    // the leading segments, loading file ranges into memory first, and
+    // consume() then advances past what the kernel accepted.
+    size_t gather(iovec* iov, size_t maxIov);
+    void consume(uint64_t bytes);
+#endif
+
+private:
+    static const size_t kStreamChunk = 16 * 1024;
+
+    void pushSegment(BodySegment&& seg);
+    void consumeFront(uint64_t bytes);
+    bool refill(BodySegment& seg);
+    bool sendFileSegment(SOCKET s, BodySegment& seg, FlushResult& result);
+
+    RequestArena responseArena;
+    std::vector<BodySegment> segments;  // Sent segments before first are dropped in bulk
+    size_t first = 0;
+    std::chrono::steady_clock::time_point queuedAt;  // When the queue last became non-empty
+    uint64_t queuedRequest = 0;                      // Trace request id at that point
+};
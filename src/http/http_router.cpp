@@ -0,0 +1,190 @@
+#include "http_router.hpp"
+#include <array>
+
+namespace {
+
+using Method = HttpMetrics::Method;
+using Route = HttpMetrics::Route;
+using Endpoint = HttpRouter::Endpoint;
+
+struct RouteDef {
+    Method method;
+    std::string_view pattern;  // At most one ":name" segment
+    Endpoint endpoint;
+    Route route;               // Metrics label, shared by every method on the pattern
+};
+
+constexpr RouteDef kRoutes[] = {
+    {Method::Get, "/", Endpoint::Index, Route::Index},
+    {Method::Get, "/index.html", Endpoint::Index, Route::Index},
+    {Method::Get, "/style.css", Endpoint::Style, Route::Style},
+    {Method::Get, "/app.js", Endpoint::Script, Route::Script},
+    {Method::Get, "/favicon.ico", Endpoint::Favicon, Route::Favicon},
+    {Method::Get, "/messages", Endpoint::ListMessages, Route::Messages},
+    {Method::Post, "/messages", Endpoint::PostMessage, Route::Messages},
+    {Method::Get, "/messages/:id", Endpoint::GetMessage, Route::Message},
+    {Method::Post, "/messages/import", Endpoint::ImportMessages, Route::Import},
+    {Method::Get, "/peers", Endpoint::Peers, Route::Peers},
+    {Method::Post, "/clear", Endpoint::Clear, Route::Clear},
+    {Method::Get, "/metrics", Endpoint::Metrics, Route::Metrics},
+    {Method::Get, "/debug/traces", Endpoint::Traces, Route::Traces},
+};
+
+constexpr size_t kMethods = static_cast<size_t>(Method::Count);
+constexpr size_t kSlots = 32;  // Power of two, at least twice the literal paths
+
+constexpr bool isPattern(std::string_view path) {
+    return path.find(':') != std::string_view::npos;
+}
+
+constexpr uint32_t hashPath(std::string_view path, uint32_t seed) {
+    uint32_t h = 2166136261u ^ seed;  // FNV-1a
+    for (char c : path) {
+        h ^= static_cast<unsigned char>(c);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+constexpr size_t slotOf(std::string_view path, uint32_t seed) {
+    return hashPath(path, seed) & (kSlots - 1);
+}
+
+constexpr bool routesValid() {
+    for (size_t i = 0; i < std::size(kRoutes); ++i) {
+        const RouteDef& a = kRoutes[i];
+        if (a.pattern.empty() || a.pattern[0] != '/' || a.method == Method::Other) return false;
+        size_t colon = a.pattern.find(':');
+        if (colon != std::string_view::npos && (a.pattern[colon - 1] != '/' || a.pattern.find(':', colon + 1) != std::string_view::npos)) {
+            return false;
+        }
+        for (size_t j = 0; j < i; ++j) {
+            const RouteDef& b = kRoutes[j];
+            if (a.pattern == b.pattern && (a.method == b.method || a.route != b.route)) return false;
+        }
+    }
+    return true;
+}
+static_assert(routesValid(), "route table: bad pattern, duplicate route, or one path with two metric routes");
+
+// First seed under which no two distinct literal paths share a slot
+constexpr uint32_t findSeed() {
+    for (uint32_t seed = 1; seed < 100000; ++seed) {
+        std::string_view taken[kSlots] = {};
+        bool clash = false;
+        for (const RouteDef& r : kRoutes) {
+            if (isPattern(r.pattern)) continue;
+            std::string_view& slot = taken[slotOf(r.pattern, seed)];
+            if (!slot.empty() && slot != r.pattern) {
+                clash = true;
+                break;
+            }
+            slot = r.pattern;
+        }
+        if (!clash) return seed;
+    }
+    return 0;
+}
+constexpr uint32_t kSeed = findSeed();
+static_assert(kSeed != 0, "route table: no perfect hash seed; grow kSlots");
+
+struct Slot {
+    std::string_view path;  // Empty if unused
+    Route route = Route::Other;
+    uint8_t allowed = 0;
+    std::array<Endpoint, kMethods> endpoints{};
+};
+
+constexpr std::array<Slot, kSlots> buildTable() {
+    std::array<Slot, kSlots> table{};
+    for (Slot& slot : table) {
+        for (Endpoint& e : slot.endpoints) e = Endpoint::None;
+    }
+    for (const RouteDef& r : kRoutes) {
+        if (isPattern(r.pattern)) continue;
+        Slot& slot = table[slotOf(r.pattern, kSeed)];
+        slot.path = r.pattern;
+        slot.route = r.route;
+        slot.allowed |= 1u << static_cast<size_t>(r.method);
+        slot.endpoints[static_cast<size_t>(r.method)] = r.endpoint;
+    }
+    return table;
+}
+constexpr std::array<Slot, kSlots> kTable = buildTable();
+
+// "/messages/:id" as "/messages/" + one segment + ""
+struct PatternRoute {
+    std::string_view prefix;
+    std::string_view suffix;
+    Method method = Method::Get;
+    Endpoint endpoint = Endpoint::None;
+    Route route = Route::Other;
+
+    bool matches(std::string_view path, std::string_view& param) const {
+        if (path.size() <= prefix.size() + suffix.size() || path.compare(0, prefix.size(), prefix) != 0) return false;
+        size_t end = path.find('/', prefix.size());
+        if (end == std::string_view::npos) end = path.size();
+        if (end == prefix.size() || path.substr(end) != suffix) return false;
+        param = path.substr(prefix.size(), end - prefix.size());
+        return true;
+    }
+};
+
+constexpr size_t countPatterns() {
+    size_t n = 0;
+    for (const RouteDef& r : kRoutes) n += isPattern(r.pattern) ? 1 : 0;
+    return n;
+}
+
+constexpr std::array<PatternRoute, countPatterns()> buildPatterns() {
+    std::array<PatternRoute, countPatterns()> out{};
+    size_t i = 0;
+    for (const RouteDef& r : kRoutes) {
+        if (!isPattern(r.pattern)) continue;
+        size_t colon = r.pattern.find(':');
+        size_t end = r.pattern.find('/', colon);
+        out[i].prefix = r.pattern.substr(0, colon);
+        out[i].suffix = end == std::string_view::npos ? std::string_view() : r.pattern.substr(end);
+        out[i].method = r.method;
+        out[i].endpoint = r.endpoint;
+        out[i].route = r.route;
+        ++i;
+    }
+    return out;
+}
+constexpr auto kPatterns = buildPatterns();
+
+}  // namespace
+
+namespace HttpRouter {
+
+Match match(HttpMetrics::Method method, std::string_view path) {
+    Match m;
+    const Slot& slot = kTable[slotOf(path, kSeed)];
+    if (!slot.path.empty() && slot.path == path) {
+        m.route = slot.route;
+        m.allowed = slot.allowed;
+        m.endpoint = slot.endpoints[static_cast<size_t>(method)];
+        return m;
+    }
+    for (const PatternRoute& r : kPatterns) {
+        std::string_view param;
+        if (!r.matches(path, param)) continue;
+        m.route = r.route;
+        m.allowed |= 1u << static_cast<size_t>(r.method);
+        if (r.method == method) {
+            m.endpoint = r.endpoint;
+            m.param = param;
+            return m;
+        }
+    }
+    return m;
+}
+
+std::string_view allowHeader(uint8_t allowed) {
+    static_assert(static_cast<size_t>(Method::Get) == 0 && static_cast<size_t>(Method::Post) == 1, "Allow table order");
+    constexpr std::string_view kAllow[] = {"", "GET", "POST", "GET, POST"};
+    return kAllow[allowed & 3];
+}
+
+}  // namespace HttpRouter
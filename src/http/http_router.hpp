@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include "http_metrics.hpp"
+
+// The server's endpoints as one table fixed at compile time (http_router.cpp).
+// Literal paths are found through a perfect hash whose seed is searched for
+// by the compiler; patterns with a ":name" segment are tried after them. A
+// literal path owns every method, so /messages/import is never taken for
+// /messages/:id. Matching is O(path length) and does not allocate.
+namespace HttpRouter {
+
+enum class Endpoint : uint8_t {
+    Index, Style, Script, Favicon, ListMessages, GetMessage, PostMessage, ImportMessages, Peers, Clear, Metrics,
+    Traces, None
+};
+
+struct Match {
+    Endpoint endpoint = Endpoint::None;  // None: 405 if allowed is set, else 404
+    HttpMetrics::Route route = HttpMetrics::Route::Other;
+    std::string_view param;  // The ":name" segment's value; points into the path
+    uint8_t allowed = 0;     // Methods the path accepts, one bit per HttpMetrics::Method
+};
+
+Match match(HttpMetrics::Method method, std::string_view path);
+// Value of the Allow header for a 405, e.g. "GET, POST"
+std::string_view allowHeader(uint8_t allowed);
+
+}  // namespace HttpRouter
@@ -0,0 +1,214 @@
+#include "http_scan.hpp"
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define HTTP_SCAN_X86 1
+#include <emmintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+#include <immintrin.h>
+#define HTTP_SCAN_AVX2 1
+#endif
+#endif
+
+namespace HttpScan {
+
+namespace {
+
+size_t scalarFindByte(const char* data, size_t len, char c) {
+    for (size_t i = 0; i < len; ++i) {
+        if (data[i] == c) return i;
+    }
+    return len;
+}
+
+// Checks for a blank line ending at data[i], which must be a '\n' with i >= 1
+size_t terminatorAt(const char* data, size_t i) {
+    if (data[i - 1] == '\n') return i + 1;
+    if (i >= 2 && data[i - 1] == '\r' && data[i - 2] == '\n') return i + 1;
+    return 0;
+}
+
+size_t scalarFindHeaderEnd(const char* data, size_t len) {
+    for (size_t i = 1; i < len; ++i) {
+        if (data[i] == '\n') {
+            size_t end = terminatorAt(data, i);
+            if (end) return end;
+        }
+    }
+    return 0;
+}
+
+#ifdef HTTP_SCAN_X86
+
+inline unsigned ctz(unsigned mask) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long idx;
+    _BitScanForward(&idx, mask);
+    return idx;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#define HTTP_SCAN_INLINE __forceinline
+#else
+#define HTTP_SCAN_INLINE inline __attribute__((always_inline))
+#endif
+
+// The SSE2 bodies are force-inlined so the AVX2 kernels can reuse them for
+// their tails; inlined there they are VEX-encoded, avoiding the SSE/AVX
+// transition penalty a call into legacy-encoded code would pay.
+HTTP_SCAN_INLINE size_t sse2FindByteImpl(const char* data, size_t len, char c) {
+    const __m128i needle = _mm_set1_epi8(c);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle)));
+        if (mask) return i + ctz(mask);
+    }
+    size_t rest = scalarFindByte(data + i, len - i, c);
+    return i + rest;
+}
+
+// A header block ends at a '\n' that is preceded by "\n" or "\n\r", so only
+// '\n' candidates whose neighbours match need the scalar check
+HTTP_SCAN_INLINE size_t sse2FindHeaderEndImpl(const char* data, size_t len) {
+    const __m128i lf = _mm_set1_epi8('\n');
+    size_t i = 1;
+    for (; i + 16 <= len; i += 16) {
+        __m128i cur = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i prev = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i - 1));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(cur, lf)));
+        // Drop '\n' whose predecessor is neither '\n' nor '\r'
+        __m128i prevOk = _mm_or_si128(_mm_cmpeq_epi8(prev, lf), _mm_cmpeq_epi8(prev, _mm_set1_epi8('\r')));
+        mask &= static_cast<unsigned>(_mm_movemask_epi8(prevOk));
+        while (mask) {
+            size_t end = terminatorAt(data, i + ctz(mask));
+            if (end) return end;
+            mask &= mask - 1;
+        }
+    }
+    for (; i < len; ++i) {
+        if (data[i] == '\n') {
+            size_t end = terminatorAt(data, i);
+            if (end) return end;
+        }
+    }
+    return 0;
+}
+
+size_t sse2FindByte(const char* data, size_t len, char c) {
+    return sse2FindByteImpl(data, len, c);
+}
+
+size_t sse2FindHeaderEnd(const char* data, size_t len) {
+    return sse2FindHeaderEndImpl(data, len);
+}
+
+#ifdef HTTP_SCAN_AVX2
+
+__attribute__((target("avx2")))
+size_t avx2FindByte(const char* data, size_t len, char c) {
+    const __m256i needle = _mm256_set1_epi8(c);
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, needle)));
+        if (mask) return i + ctz(mask);
+    }
+    return i + sse2FindByteImpl(data + i, len - i, c);
+}
+
+__attribute__((target("avx2")))
+size_t avx2FindHeaderEnd(const char* data, size_t len) {
+    const __m256i lf = _mm256_set1_epi8('\n');
+    const __m256i cr = _mm256_set1_epi8('\r');
+    size_t i = 1;
+    for (; i + 32 <= len; i += 32) {
+        __m256i cur = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        __m256i prev = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i - 1));
+        __m256i hit = _mm256_and_si256(_mm256_cmpeq_epi8(cur, lf),
+                                       _mm256_or_si256(_mm256_cmpeq_epi8(prev, lf), _mm256_cmpeq_epi8(prev, cr)));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(hit));
+        while (mask) {
+            size_t end = terminatorAt(data, i + ctz(mask));
+            if (end) return end;
+            mask &= mask - 1;
+        }
+    }
+    // Finish the tail with the SSE2 kernel, rewound so it still sees the two
+    // bytes before data[i]
+    if (i < 2) return sse2FindHeaderEndImpl(data, len);
+    size_t rest = sse2FindHeaderEndImpl(data + i - 2, len - i + 2);
+    return rest ? i - 2 + rest : 0;
+}
+
+#endif  // HTTP_SCAN_AVX2
+#endif  // HTTP_SCAN_X86
+
+Isa supportedIsa() {
+#ifdef HTTP_SCAN_X86
+#ifdef HTTP_SCAN_AVX2
+    if (__builtin_cpu_supports("avx2")) return Isa::AVX2;
+#endif
+    return Isa::SSE2;
+#else
+    return Isa::Scalar;
+#endif
+}
+
+struct Kernels {
+    Isa isa;
+    size_t (*findByte)(const char*, size_t, char);
+    size_t (*findHeaderEnd)(const char*, size_t);
+};
+
+Kernels kernelsFor(Isa isa) {
+    switch (isa) {
+#ifdef HTTP_SCAN_X86
+#ifdef HTTP_SCAN_AVX2
+    case Isa::AVX2:
+        return {Isa::AVX2, avx2FindByte, avx2FindHeaderEnd};
+#endif
+    case Isa::SSE2:
+        return {Isa::SSE2, sse2FindByte, sse2FindHeaderEnd};
+#endif
+    default:
+        return {Isa::Scalar, scalarFindByte, scalarFindHeaderEnd};
+    }
+}
+
+Kernels& kernels() {
+    static Kernels k = kernelsFor(supportedIsa());
+    return k;
+}
+
+}  // namespace
+
+size_t findByte(const char* data, size_t len, char c) {
+    return kernels().findByte(data, len, c);
+}
+
+size_t findHeaderEnd(const char* data, size_t len) {
+    return kernels().findHeaderEnd(data, len);
+}
+
+Isa activeIsa() {
+    return kernels().isa;
+}
+
+void forceIsa(Isa isa) {
+    if (static_cast<int>(isa) > static_cast<int>(supportedIsa())) isa = supportedIsa();
+    kernels() = kernelsFor(isa);
+}
+
+const char* isaName(Isa isa) {
+    switch (isa) {
+    case Isa::AVX2: return "avx2";
+    case Isa::SSE2: return "sse2";
+    default: return "scalar";
+    }
+}
+
+}  // namespace HttpScan
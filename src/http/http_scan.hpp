@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+
+// Byte-scanning kernels used by HttpParser. Each has a scalar version and
+// SSE2/AVX2 versions on x86; the widest one the CPU supports is picked on
+// first use.
+namespace HttpScan {
+
+enum class Isa { Scalar, SSE2, AVX2 };
+
+// Offset of the first c, or len if there is none
+size_t findByte(const char* data, size_t len, char c);
+// Offset just past the blank line ending a header block ("\r\n\r\n" or "\n\n"),
+// or 0 if the block is not complete yet
+size_t findHeaderEnd(const char* data, size_t len);
+
+Isa activeIsa();
+// Overrides the runtime choice (clamped to what the CPU supports); for benchmarks
+void forceIsa(Isa isa);
+const char* isaName(Isa isa);
+
+}  // namespace HttpScan
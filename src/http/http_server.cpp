@@ -1,15 +1,215 @@
 #include "http_server.hpp"
-#include <iostream>
-#include <sstream>
+#include "epoll_reactor.hpp"
+#include "io_uring_engine.hpp"
+#include "http_metrics.hpp"
+#include <string_view>
 #include <nlohmann/json.hpp>
-#include <fstream>  // For file loading
 #include "../util/utils.hpp"
+#include "../util/json_fields.hpp"
+#include "../util/log.hpp"
+#include "../util/trace.hpp"
 #include <chrono>
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <functional>
+#include <cstring>
 
 using json = nlohmann::json;
 
-HttpServer::HttpServer(int p, MessageHandler& mh, PeerDiscovery& pd)
-    : port(p), msgHandler(mh), peerDisc(pd) {}
+namespace {
+
+// Above this many messages GET /messages is streamed instead of built in memory
+const size_t kStreamMessagesAbove = 1000;
+
+#ifdef MSG_NOSIGNAL
+const int kShedSendFlags = MSG_NOSIGNAL;
+#else
+const int kShedSendFlags = 0;
+#endif
+
+// Status line text for every code the server sends
+const char* reasonPhrase(int code) {
+    switch (code) {
+    case 100: return "Continue";
+    case 200: return "OK";
+    case 204: return "No Content";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 413: return "Payload Too Large";
+    case 429: return "Too Many Requests";
+    case 431: return "Request Header Fields Too Large";
+    case 500: return "Internal Server Error";
+    case 501: return "Not Implemented";
+    case 503: return "Service Unavailable";
+    default: return code < 400 ? "OK" : "Error";
+    }
+}
+
+// GET /messages for large histories: walks a snapshot and encodes one
+// message at a time, so memory use and the time to the first byte don't grow
+// with the history.
+class MessageExportStream : public BodyStream {
+public:
+    explicit MessageExportStream(std::shared_ptr<const std::vector<Message>> snapshot)
+        : messages(std::move(snapshot)) {
+        pending = "[";
+    }
+
+    size_t read(char* buf, size_t cap) override {
+        size_t n = 0;
+        while (n < cap) {
+            if (pos == pending.size() && !next()) break;
+            size_t take = std::min(cap - n, pending.size() - pos);
+            std::memcpy(buf + n, pending.data() + pos, take);
+            pos += take;
+            n += take;
+        }
+        return n;
+    }
+
+private:
+    bool next() {
+        pending.clear();
+        pos = 0;
+        if (index == messages->size()) {
+            if (closed) return false;
+            pending = "]";
+            closed = true;
+            return true;
+        }
+        if (index > 0) pending += ',';
+        appendJson(pending, (*messages)[index++]);
+        return true;
+    }
+
+    std::shared_ptr<const std::vector<Message>> messages;
+    size_t index = 0;
+    std::string pending;  // Current message, reused between messages
+    size_t pos = 0;
+    bool closed = false;
+};
+
+// POST /messages/import: newline-delimited JSON, one {"user", "message"}
+// object per line. Lines are imported as they arrive and stored in batches,
+// so an upload of any size only holds one line and one batch in memory.
+class MessageImport : public BodyHandler {
+public:
+    static const size_t kMaxLine = 64 * 1024;
+    static const size_t kBatchSize = 4096;  // Every batch rewrites the message file
+
+    explicit MessageImport(MessageHandler& store) : store(store) {}
+
+    void onData(std::string_view data) override {
+        while (!data.empty()) {
+            size_t nl = data.find('\n');
+            std::string_view piece = data.substr(0, nl);
+            if (!skipping) {
+                if (partial.size() + piece.size() > kMaxLine) {
+                    ++rejected;  // Oversized line: drop it up to the next newline
+                    skipping = true;
+                    partial.clear();
+                } else {
+                    partial.append(piece);
+                }
+            }
+            if (nl == std::string_view::npos) break;
+            if (!skipping) importLine(partial);
+            partial.clear();
+            skipping = false;
+            data.remove_prefix(nl + 1);
+        }
+    }
+
+    HttpResponse finish() override {
+        if (!skipping) importLine(partial);
+        store.addMessages(batch);
+        json result = {{"imported", imported}, {"rejected", rejected}};
+        HttpResponse res;
+        res.contentType = "application/json";
+        res.setBody(result.dump());
+        return res;
+    }
+
+private:
+    void importLine(std::string_view line) {
+        line = line.substr(0, line.find_last_not_of(" \t\r") + 1);
+        if (line.empty()) return;
+        std::string_view user = "anonymous";
+        std::string_view message;
+        if (!fields.parse(line) || !fields.get("user", user) || !fields.get("message", message) || message.empty()) {
+            ++rejected;
+            return;
+        }
+        Message msg{std::string(user), std::string(message)};
+        msg.generateId();
+        msg.generateTimestamp();
+        batch.push_back(std::move(msg));
+        ++imported;
+        if (batch.size() == kBatchSize) {
+            store.addMessages(batch);
+            batch.clear();
+        }
+    }
+
+    MessageHandler& store;
+    std::string partial;
+    bool skipping = false;
+    JsonFields fields{"user", "message"};  // Reused so its scratch buffer is too
+    std::vector<Message> batch;
+    size_t imported = 0;
+    size_t rejected = 0;
+};
+
+}  // namespace
+
+HttpServer::HttpServer(int p, MessageHandler& mh, PeerDiscovery& pd, const HttpServerConfig& cfg)
+    : port(p), msgHandler(mh), peerDisc(pd), config(cfg) {
+    if (config.workerThreads == 0) {
+        config.workerThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+#ifndef LANCHAT_HAVE_IO_URING
+    if (config.ioMode == IoMode::IoUring) {
+        LOG_WARN("io_fallback", {"requested", "uring"}, {"using", "epoll"}, {"reason", "built without io_uring"});
+        config.ioMode = IoMode::Epoll;
+    }
+#endif
+#ifndef __linux__
+    if (config.ioMode == IoMode::Epoll) {
+        LOG_WARN("io_fallback", {"requested", "epoll"}, {"using", "threaded"}, {"reason", "no epoll on this platform"});
+        config.ioMode = IoMode::Threaded;
+    }
+#endif
+    const std::string_view body = "Service Unavailable";
+    shedResponse = "HTTP/1.1 503 Service Unavailable\r\nRetry-After: " + std::to_string(config.retryAfter.count()) +
+                   "\r\nContent-Type: text/plain\r\nContent-Length: " + std::to_string(body.size()) +
+                   "\r\nConnection: close\r\n\r\n";
+    shedResponse += body;
+
+    if (config.connectionRate.enabled()) {
+        const std::string_view limited = "Too Many Requests";
+        auto wait = static_cast<uint32_t>(std::max(1.0, std::ceil(1 / config.connectionRate.perSecond)));
+        limitedResponse = "HTTP/1.1 429 Too Many Requests\r\nRetry-After: " + std::to_string(wait) +
+                          "\r\nContent-Type: text/plain\r\nContent-Length: " + std::to_string(limited.size()) +
+                          "\r\nConnection: close\r\n\r\n";
+        limitedResponse += limited;
+    }
+    if (!config.requestRates.empty()) {
+        const size_t routes = static_cast<size_t>(HttpMetrics::Route::Count);
+        routeLimits.resize(static_cast<size_t>(HttpMetrics::Method::Count) * routes);
+        for (const RouteRateLimit& rule : config.requestRates) {
+            auto route = HttpMetrics::routeOf(rule.path);
+            if (route == HttpMetrics::Route::Other) {
+                LOG_WARN("rate_limit_unknown_route", {"method", rule.method}, {"path", rule.path});
+                continue;
+            }
+            routeLimits[static_cast<size_t>(HttpMetrics::methodOf(rule.method)) * routes +
+                        static_cast<size_t>(route)] = rule.limit;
+        }
+    }
+}
 
 HttpServer::~HttpServer() {
     stop();
@@ -18,231 +218,723 @@ HttpServer::~HttpServer() {
 void HttpServer::start() {
     if (running) return;
     running = true;
+#ifdef LANCHAT_HAVE_IO_URING
+    if (config.ioMode == IoMode::IoUring) {
+        uring = std::make_unique<IoUringEngine>(*this);
+        if (!uring->init()) {
+            LOG_WARN("io_fallback", {"requested", "uring"}, {"using", "epoll"}, {"reason", "io_uring unavailable"});
+            uring.reset();
+            config.ioMode = IoMode::Epoll;
+        }
+    }
+#endif
+#ifdef __linux__
+    if (config.ioMode == IoMode::Epoll) {
+        reactor = std::make_unique<EpollReactor>(*this, config.eventLoops, config.pinEventLoops);
+    }
+#endif
+    if (config.ioMode == IoMode::Threaded) {
+        pool = std::make_unique<ThreadPool>(config.workerThreads, config.maxQueueDepth);
+    }
     serverTh = std::thread(&HttpServer::serverLoop, this);
 }
 
 void HttpServer::stop() {
     if (!running) return;
     running = false;
+#ifdef __linux__
+    if (reactor) reactor->stop();
+#endif
+#ifdef LANCHAT_HAVE_IO_URING
+    if (uring) uring->stop();
+#endif
     tcpServer.close();
     if (serverTh.joinable()) serverTh.join();
+    shardServers.clear();  // Only touched by serverLoop, so safe once joined
+#ifdef __linux__
+    reactor.reset();
+#endif
+#ifdef LANCHAT_HAVE_IO_URING
+    uring.reset();
+#endif
+    if (pool) {
+        pool->shutdown();
+        auto s = pool->stats();
+        LOG_INFO("worker_pool_stats", {"handled", s.completed}, {"rejected", s.rejected},
+                 {"avg_wait_us", s.completed ? s.totalWaitUs / s.completed : 0}, {"max_wait_us", s.maxWaitUs});
+    }
+}
+
+bool HttpServer::reusePortEnabled() const {
+#if defined(__linux__) && defined(SO_REUSEPORT)
+    return config.reusePort && config.ioMode == IoMode::Epoll && config.eventLoops > 1;
+#else
+    return false;
+#endif
+}
+
+ThreadPool::Stats HttpServer::poolStats() const {
+    return pool ? pool->stats() : ThreadPool::Stats();
 }
 
 void HttpServer::serverLoop() {
-    if (!tcpServer.listen(port)) {
-        std::cerr << "Failed to start HTTP server on port " << port << std::endl;
+    bool sharded = reusePortEnabled();
+    if (!tcpServer.listen(port, config.listenBacklog, sharded)) {
+        LOG_ERROR("listen_failed", {"port", port});
         running = false;
         return;
     }
-    std::cout << "HTTP server listening on port " << port << std::endl;
+#ifdef LANCHAT_HAVE_IO_URING
+    if (uring) {
+        LOG_INFO("listening", {"port", port}, {"io", "uring"});
+        uring->run(tcpServer.nativeHandle());
+        return;
+    }
+#endif
+#ifdef __linux__
+    if (reactor) {
+        std::vector<SOCKET> listeners{tcpServer.nativeHandle()};
+        for (size_t i = 1; sharded && i < config.eventLoops; ++i) {
+            auto shard = std::make_unique<TCPServer>();
+            if (!shard->listen(port, config.listenBacklog, true)) {
+                LOG_ERROR("reuseport_listener_failed", {"index", i});
+                break;
+            }
+            listeners.push_back(shard->nativeHandle());
+            shardServers.push_back(std::move(shard));
+        }
+        LOG_INFO("listening", {"port", port}, {"io", "epoll"}, {"event_loops", config.eventLoops},
+                 {"listeners", listeners.size()});
+        reactor->run(listeners);
+        return;
+    }
+#endif
+    LOG_INFO("listening", {"port", port}, {"io", "threaded"}, {"workers", config.workerThreads});
     while (running) {
         sockaddr_in clientAddr;
         SOCKET clientSock = tcpServer.acceptClient(clientAddr);
         if (clientSock != INVALID_SOCKET) {
-            std::thread(&HttpServer::handleClient, this, clientSock).detach();
+            uint32_t client = ntohl(clientAddr.sin_addr.s_addr);
+            if (limitConnection(client)) {
+                shed(clientSock, HttpMetrics::Shed::ClientRate);
+            } else if (!admit()) {
+                shed(clientSock, HttpMetrics::Shed::Connections);
+            } else if (!pool->submit([this, clientSock, client] { handleClient(clientSock, client); })) {
+                // Queue is full: turn the connection away rather than grow without bound
+                release();
+                shed(clientSock, HttpMetrics::Shed::Queue);
+            }
         }
     }
 }
 
-void HttpServer::handleClient(SOCKET clientSock) {
-    std::cout << "[DEBUG] Handling new client connection" << std::endl;
+bool HttpServer::admit() {
+    size_t open = openConnections.fetch_add(1, std::memory_order_relaxed);
+    if (config.maxConnections == 0 || open < config.maxConnections) return true;
+    openConnections.fetch_sub(1, std::memory_order_relaxed);
+    return false;
+}
+
+void HttpServer::shed(SOCKET fd, HttpMetrics::Shed reason) {
+    HttpMetrics::instance().countShed(reason);
+    const char* why = reason == HttpMetrics::Shed::Connections ? "connections"
+                      : reason == HttpMetrics::Shed::Queue     ? "queue"
+                                                               : "client_rate";
+    LOG_DEBUG("connection_shed", {"reason", why});
+    const std::string& response = reason == HttpMetrics::Shed::ClientRate ? limitedResponse : shedResponse;
+    // Nothing here may wait on the client. Request bytes that already arrived
+    // are discarded unread, so the close sends a FIN instead of a reset that
+    // could destroy the 503 before the client reads it.
+    SocketUtils::setNonBlocking(fd, true);
+    char discard[4096];
+    while (::recv(fd, discard, sizeof(discard), 0) > 0) {}
+    ::send(fd, response.data(), static_cast<int>(response.size()), kShedSendFlags);
+    CLOSE_SOCKET(fd);
+}
+
+uint32_t HttpServer::limitConnection(uint32_t client) {
+    return rateLimiter.acquire(client, 0, config.connectionRate);
+}
+
+uint32_t HttpServer::limitRequest(const HttpSession& session, const HttpRequest& req) {
+    if (routeLimits.empty()) return 0;
+    size_t index = static_cast<size_t>(HttpMetrics::methodOf(req.method)) * static_cast<size_t>(HttpMetrics::Route::Count) +
+                   static_cast<size_t>(HttpMetrics::routeOf(req.path));
+    // Class 0 is the connection bucket
+    return rateLimiter.acquire(session.client, static_cast<uint16_t>(index + 1), routeLimits[index]);
+}
+
+void HttpServer::pushLimited(ResponseQueue& out, const HttpRequest& req, uint32_t retryAfter, bool keepAlive) {
+    LOG_DEBUG("request_limited", {"method", req.method}, {"path", req.path}, {"retry_after", retryAfter});
+    RequestArena::Scope scope(out.arena());
+    HttpResponse response = buildResponse("Too Many Requests", "text/plain", 429);
+    response.retryAfter = retryAfter;
+    serializeResponse(response, keepAlive);
+    HttpMetrics::instance().countRequest(HttpMetrics::methodOf(req.method), HttpMetrics::routeOf(req.path), 429);
+    out.push(std::move(response));
+}
+
+std::chrono::steady_clock::time_point HttpServer::deadline(HttpSession& session, bool writing,
+                                                           std::chrono::steady_clock::time_point now) const {
+    using Timeout = HttpMetrics::Timeout;
+    Timeout phase = writing          ? Timeout::Send
+                    : session.upload || session.parser.readingBody() ? Timeout::Body
+                    // An empty buffer between requests is a keep-alive idle wait
+                    : session.in.empty() && session.served > 0 ? Timeout::Idle
+                                                               : Timeout::Header;
+    // Each request gets its own header and body time, even when pipelined
+    if (phase != session.waiting || session.served != session.waitingServed) {
+        session.waiting = phase;
+        session.waitingSince = now;
+        session.waitingServed = session.served;
+    }
+    switch (phase) {
+    case Timeout::Body: return session.waitingSince + config.bodyTimeout;
+    case Timeout::Idle: return session.waitingSince + config.keepAliveTimeout;
+    case Timeout::Send: return session.waitingSince + config.sendTimeout;
+    default: return session.waitingSince + config.requestTimeout;
+    }
+}
+
+void HttpServer::timedOut(const HttpSession& session) const {
+    HttpMetrics::instance().countTimeout(session.waiting);
+    if (session.waiting == HttpMetrics::Timeout::Idle) return;
+    const char* phase = session.waiting == HttpMetrics::Timeout::Header ? "header"
+                        : session.waiting == HttpMetrics::Timeout::Body ? "body"
+                                                                        : "send";
+    LOG_WARN("request_timeout", {"phase", phase}, {"buffered", session.in.size()});
+}
+
+void HttpServer::handleClient(SOCKET clientSock, uint32_t clientAddress) {
+    LOG_DEBUG("connection_open");
     TCPSocket client(clientSock);
 
-    std::string rawRequest;
-    std::string buffer;
-    auto startTime = std::chrono::steady_clock::now();
-    bool hasBody = false;
-    size_t contentLength = 0;
-    while (true) {
-        if (!client.receive(buffer, 1024)) break;
-        rawRequest += buffer;
-
-        size_t headerEnd = rawRequest.find("\r\n\r\n");
-        if (headerEnd != std::string::npos) {
-            auto headersStr = rawRequest.substr(0, headerEnd);
-            auto contentLenPos = headersStr.find("Content-Length:");
-            if (contentLenPos != std::string::npos) {
-                std::string lenStr = headersStr.substr(contentLenPos + 15);
-                contentLength = std::stoul(lenStr.substr(0, lenStr.find("\r\n")));
-                hasBody = true;
+    HttpSession session;
+    session.client = clientAddress;
+    RecvBuffer& pending = session.in;
+    ResponseQueue& out = session.out;
+    // A worker blocks on one connection, so its deadlines are checked between
+    // waits rather than kept in a timer wheel; the kernel enforces the send one
+    SocketUtils::setSendTimeout(clientSock, static_cast<int>(config.sendTimeout.count()));
+    while (running) {
+        bool keepOpen = serveBuffered(session);
+        if (!out.empty()) {
+            auto flushed = out.flush(client.nativeHandle());
+            if (flushed == ResponseQueue::FlushResult::WouldBlock) {
+                // The send timeout passed without progress
+                deadline(session, true, std::chrono::steady_clock::now());
+                timedOut(session);
+                break;
+            }
+            if (flushed != ResponseQueue::FlushResult::Done) {
+                LOG_ERROR("send_failed");
+                break;
             }
-            if (!hasBody || rawRequest.size() >= headerEnd + 4 + contentLength) break;
         }
+        if (!keepOpen) break;
 
-        auto elapsed = std::chrono::steady_clock::now() - startTime;
-        if (std::chrono::duration_cast<std::chrono::seconds>(elapsed).count() > 5) {
-            std::cerr << "[ERROR] Request timeout" << std::endl;
+        auto now = std::chrono::steady_clock::now();
+        auto due = deadline(session, false, now);
+        if (now >= due) {
+            timedOut(session);
             break;
         }
+        // Wait in short slices so stop() is not held up by idle connections
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(due - now).count();
+        if (!client.waitReadable(static_cast<int>(std::min<long long>(remaining + 1, 500)))) continue;
+        size_t avail;
+        char* dst = pending.prepare(4096, avail);
+        int bytes = client.receive(dst, avail);
+        if (bytes <= 0) break;  // Peer closed or error
+        pending.commit(bytes);
+        if (session.waiting == HttpMetrics::Timeout::Body) session.waitingSince = std::chrono::steady_clock::now();
     }
 
-    if (rawRequest.empty()) {
-        std::cerr << "[ERROR] Empty request" << std::endl;
-        client.close();
-        return;
+    if (session.served == 0 && pending.empty()) {
+        LOG_WARN("empty_request");
     }
+    client.close();
+    release();
+    LOG_DEBUG("connection_closed", {"requests", session.served});
+}
 
-    HttpRequest req = parseRequest(rawRequest);
+bool HttpServer::serveBuffered(HttpSession& session) {
+    // Answer every complete request already buffered before reading again,
+    // so pipelined requests are served in order without extra reads
+    RecvBuffer& in = session.in;
+    ResponseQueue& out = session.out;
+    HttpParser& parser = session.parser;
+    parser.setMaxBodySize(config.maxBodySize);
+    HttpMetrics& metrics = HttpMetrics::instance();
+    size_t offset = 0;
+    bool keepOpen = true;
+    // The first bytes of a new request have just arrived
+    if (!session.reading && !in.empty()) {
+        session.reading = true;
+        session.readStarted = Trace::Clock::now();
+    }
+    while (keepOpen) {
+        if (session.upload) {
+            // Streaming body: hand over whatever has arrived and drop it from the buffer
+            Trace::RequestScope trace(session.requestId);
+            size_t used = 0;
+            auto status = session.uploadBody.decode(in.view().substr(offset), used, *session.upload);
+            offset += used;
+            if (status == BodyDecoder::Status::NeedMore) break;
+            if (status == BodyDecoder::Status::Error) {
+                LOG_WARN("bad_request_body", {"status", session.uploadBody.errorStatus()});
+                session.upload.reset();
+                pushError(out, session.uploadBody.errorStatus());
+                in.clear();
+                parser.reset();
+                return false;
+            }
+            keepOpen = session.uploadKeepAlive;
+            Trace::record("read", session.readStarted, Trace::Clock::now());
+            {
+                RequestArena::Scope scope(out.arena());
+                HttpResponse response = finishUpload(*session.upload);
+                metrics.countRequest(HttpMetrics::Method::Post, HttpMetrics::Route::Import, response.code);
+                serializeResponse(response, keepOpen);
+                out.push(std::move(response));
+            }
+            session.upload.reset();
+            parser.reset();
+            endRequest(session, session.requestId, offset < in.size());
+            continue;
+        }
 
-    std::string response;
-    try {
-        if (req.method == "GET") {
-            response = handleGet(req);
-        } else if (req.method == "POST") {
-            response = handlePost(req);
-        } else {
-            response = buildResponse("Method Not Allowed", "text/plain", 405);
+        auto parseStarted = Trace::Clock::now();
+        auto status = parser.parse(in.view().substr(offset));
+        if (status == HttpParser::Status::HeadersComplete) {
+            const HttpRequest& req = parser.request();
+            if (uint32_t wait = limitRequest(session, req)) {
+                // Answered before the body is read, so the connection cannot be reused
+                pushLimited(out, req, wait, false);
+                in.clear();
+                parser.reset();
+                return false;
+            }
+            if (auto handler = streamingHandler(req)) {
+                session.requestId = nextRequestId.fetch_add(1, std::memory_order_relaxed);
+                auto parsed = Trace::Clock::now();
+                metrics.parse.record(parsed - parseStarted);
+                Trace::record("parse", parseStarted, parsed, session.requestId);
+                LOG_DEBUG("streaming_request", {"rid", session.requestId}, {"method", req.method},
+                          {"path", req.path});
+                session.uploadKeepAlive = ++session.served < config.maxRequestsPerConnection && running &&
+                                          wantsKeepAlive(req);
+                if (req.chunked) {
+                    session.uploadBody.startChunked(config.maxStreamedBodySize);
+                } else {
+                    session.uploadBody.startLength(req.contentLength, config.maxStreamedBodySize);
+                }
+                if (session.uploadBody.errorStatus() == 0 && expectsContinue(req)) {
+                    pushContinue(out);
+                }
+                session.upload = std::move(handler);
+                offset += parser.bodyOffset();  // The headers are not needed any more
+                continue;
+            }
+            status = parser.parse(in.view().substr(offset));
+            // The client is waiting for a go-ahead before sending the body
+            if (status == HttpParser::Status::Incomplete && expectsContinue(req)) pushContinue(out);
         }
-    } catch (const std::exception& e) {
-        std::cerr << "[ERROR] Exception in handler: " << e.what() << std::endl;
-        response = buildResponse("Internal Server Error", "text/plain", 500);
+        if (status == HttpParser::Status::Incomplete) break;
+        auto parsed = Trace::Clock::now();
+        metrics.parse.record(parsed - parseStarted);
+        if (status == HttpParser::Status::Error) {
+            // Framing is lost after a malformed request, so the connection must close
+            LOG_WARN("malformed_request", {"status", parser.errorStatus()});
+            pushError(out, parser.errorStatus());
+            in.clear();
+            parser.reset();
+            return false;
+        }
+        uint64_t rid = nextRequestId.fetch_add(1, std::memory_order_relaxed);
+        Trace::record("read", session.readStarted, parsed, rid);
+        Trace::record("parse", parseStarted, parsed, rid);
+        keepOpen = ++session.served < config.maxRequestsPerConnection && running;
+        {
+            // Responses allocate from the connection's arena until they are sent
+            RequestArena::Scope scope(out.arena());
+            Trace::RequestScope trace(rid);
+            const HttpRequest& req = parser.request();
+            // Requests with a body were already checked at HeadersComplete
+            uint32_t wait = req.chunked || req.contentLength > 0 ? 0 : limitRequest(session, req);
+            if (wait) {
+                keepOpen = keepOpen && wantsKeepAlive(req);
+                pushLimited(out, req, wait, keepOpen);
+            } else {
+                out.push(processRequest(req, keepOpen, rid));
+            }
+        }
+        offset += parser.consumed();
+        parser.reset();
+        endRequest(session, rid, offset < in.size());
     }
+    in.consume(offset);
+    return keepOpen;
+}
 
-    if (!client.send(response)) {
-        std::cerr << "[ERROR] Failed to send response" << std::endl;
-    }
-    client.close();
-    std::cout << "[DEBUG] Client handled successfully" << std::endl;
+void HttpServer::pushError(ResponseQueue& out, int code) {
+    RequestArena::Scope scope(out.arena());
+    HttpResponse response = buildResponse(reasonPhrase(code), "text/plain", code);
+    serializeResponse(response, false);
+    HttpMetrics::instance().countRequest(HttpMetrics::Method::Other, HttpMetrics::Route::Invalid, code);
+    out.push(std::move(response));
 }
 
-HttpRequest HttpServer::parseRequest(const std::string& raw) {
-    std::cout << "[DEBUG] Parsing request: " << raw.substr(0, 100) << "..." << std::endl;
-    HttpRequest req;
-    std::istringstream stream(raw);
-    std::string line;
+void HttpServer::pushContinue(ResponseQueue& out) {
+    RequestArena::Scope scope(out.arena());
+    HttpResponse interim;
+    interim.head = "HTTP/1.1 100 Continue\r\n\r\n";
+    out.push(std::move(interim));
+}
 
-    std::getline(stream, line);
-    auto parts = Utils::split(line, ' ');
-    if (parts.size() >= 2) {
-        req.method = parts[0];
-        req.path = parts[1];
+std::unique_ptr<BodyHandler> HttpServer::streamingHandler(const HttpRequest& req) {
+    if (HttpRouter::match(HttpMetrics::methodOf(req.method), req.path).endpoint == HttpRouter::Endpoint::ImportMessages) {
+        return std::make_unique<MessageImport>(msgHandler);
     }
+    return nullptr;
+}
 
-    while (std::getline(stream, line) && line != "\r") {
-        if (line.empty()) break;
-        auto headerParts = Utils::split(line, ':');
-        if (headerParts.size() >= 2) {
-            std::string key = Utils::trim(headerParts[0]);
-            std::string value = Utils::trim(headerParts[1]);
-            req.headers[key] = value;
-        }
+HttpResponse HttpServer::finishUpload(BodyHandler& handler) {
+    try {
+        return handler.finish();
+    } catch (const std::exception& e) {
+        LOG_ERROR("upload_handler_exception", {"error", e.what()});
+        return buildResponse("Internal Server Error", "text/plain", 500);
     }
+}
 
-    std::string body;
-    while (std::getline(stream, line)) {
-        body += line + "\n";
-    }
-    req.body = Utils::trim(body);
-    return req;
+bool HttpServer::expectsContinue(const HttpRequest& req) {
+    std::string_view expect = req.header("Expect");
+    return req.version == "HTTP/1.1" && expect.size() == 12 &&
+           std::equal(expect.begin(), expect.end(), "100-continue",
+               [](char a, char b) { return std::tolower(static_cast<unsigned char>(a)) == b; });
 }
 
-std::string HttpServer::buildResponse(const std::string& body, const std::string& contentType, int code) {
-    std::ostringstream res;
-    res << "HTTP/1.1 " << code << " " << (code == 200 ? "OK" : "Error") << "\r\n";
-    res << "Content-Type: " << contentType << "\r\n";
-    res << "Content-Length: " << body.size() << "\r\n";
-    res << "Access-Control-Allow-Origin: *" << "\r\n";
-    res << "Access-Control-Allow-Methods: GET, POST" << "\r\n";
-    res << "Access-Control-Allow-Headers: Content-Type" << "\r\n";
-    res << "Connection: close\r\n\r\n";
-    res << body;
-    return res.str();
+void HttpServer::endRequest(HttpSession& session, uint64_t rid, bool nextArrived) {
+    auto now = Trace::Clock::now();
+    Trace::record("request", session.readStarted, now, rid);
+    session.reading = nextArrived;
+    session.readStarted = now;
 }
 
-std::string HttpServer::handleGet(const HttpRequest& req) {
-    std::cout << "[DEBUG] Handling GET for path: " << req.path << std::endl;
+HttpResponse HttpServer::processRequest(const HttpRequest& req, bool& keepAlive, uint64_t rid) {
+    HttpMetrics& metrics = HttpMetrics::instance();
+    auto started = Trace::Clock::now();
+    keepAlive = keepAlive && wantsKeepAlive(req);
 
-    // Serve files from web/ folder
-    if (req.path == "/" || req.path == "/index.html") {
-        std::ifstream file("web/index.html");
-        if (file) {
-            std::stringstream buffer;
-            buffer << file.rdbuf();
-            return buildResponse(buffer.str(), "text/html", 200);
+    auto method = HttpMetrics::methodOf(req.method);
+    auto route = HttpRouter::match(method, req.path);
+    HttpResponse response;
+    try {
+        if (route.endpoint != HttpRouter::Endpoint::None) {
+            response = handle(route, req);
+        } else if (route.allowed) {
+            response = buildResponse("Method Not Allowed", "text/plain", 405);
+            response.allow = HttpRouter::allowHeader(route.allowed);
         } else {
-            std::cerr << "[ERROR] web/index.html not found" << std::endl;
-            return buildResponse("Index file not found", "text/plain", 404);
+            response = buildResponse("Not Found", "text/plain", 404);
         }
-    } else if (req.path == "/style.css") {
-        std::ifstream file("web/style.css");
-        if (file) {
-            std::stringstream buffer;
-            buffer << file.rdbuf();
-            return buildResponse(buffer.str(), "text/css", 200);
-        } else {
-            return buildResponse("CSS file not found", "text/plain", 404);
-        }
-    } else if (req.path == "/app.js") {
-        std::ifstream file("web/app.js");
-        if (file) {
-            std::stringstream buffer;
-            buffer << file.rdbuf();
-            return buildResponse(buffer.str(), "application/javascript", 200);
+    } catch (const std::exception& e) {
+        LOG_ERROR("handler_exception", {"rid", rid}, {"path", req.path}, {"error", e.what()});
+        response = buildResponse("Internal Server Error", "text/plain", 500);
+    }
+    if (response.streamed()) {
+        // No length up front: chunked for 1.1, end-of-connection for 1.0
+        if (req.version == "HTTP/1.1") {
+            response.chunked = true;
         } else {
-            return buildResponse("JS file not found", "text/plain", 404);
-        }
-    } else if (req.path == "/favicon.ico") {
-        std::ifstream file("web/favicon.ico", std::ios::binary);
-        if (file) {
-            std::stringstream buffer;
-            buffer << file.rdbuf();
-            return buildResponse(buffer.str(), "image/x-icon", 200);
+            keepAlive = false;
+        }
+    }
+    auto handled = Trace::Clock::now();
+    metrics.handle.record(handled - started);
+    Trace::record("handle", started, handled, rid);
+    serializeResponse(response, keepAlive);
+    auto serialized = Trace::Clock::now();
+    metrics.serialize.record(serialized - handled);
+    Trace::record("serialize", handled, serialized, rid);
+    metrics.countRequest(method, route.route, response.code);
+    if (Log::enabled(Log::Level::Debug)) {
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(serialized - started);
+        LOG_DEBUG("request", {"rid", rid}, {"method", req.method}, {"path", req.path}, {"status", response.code},
+                  {"bytes", response.bodySize()}, {"us", us.count()});
+    }
+    return response;
+}
+
+bool HttpServer::wantsKeepAlive(const HttpRequest& req) {
+    std::string_view connection = req.header("Connection");
+    auto is = [&connection](std::string_view token) {
+        return connection.size() == token.size() &&
+               std::equal(connection.begin(), connection.end(), token.begin(),
+                   [](char a, char b) { return std::tolower(static_cast<unsigned char>(a)) == b; });
+    };
+    // HTTP/1.1 is persistent unless the client opts out; 1.0 must opt in
+    if (req.version == "HTTP/1.1") return !is("close");
+    return is("keep-alive");
+}
+
+HttpResponse HttpServer::buildResponse(std::string_view body, std::string_view contentType, int code) {
+    HttpResponse res;
+    res.code = code;
+    res.contentType = contentType;
+    res.setBody(body);
+    return res;
+}
+
+HttpResponse HttpServer::buildFileResponse(const char* path, std::string_view contentType) {
+    HttpResponse res;
+    std::shared_ptr<const FileHandle> file;
+    {
+        // Cached handles are revalidated with stat() so edited files are picked up
+        std::lock_guard<std::mutex> lock(staticFilesMutex);
+        auto it = staticFiles.find(std::string_view(path));
+        if (it != staticFiles.end() && it->second->matches(path)) {
+            file = it->second;
         } else {
-            return buildResponse("", "image/x-icon", 204);  // Empty to silence browser warnings
-        }
-    } else if (req.path == "/messages") {
-        json j = json::array();
-        for (const auto& m : msgHandler.getAllMessages()) {
-            j.push_back({
-                {"id", m.id},
-                {"user", m.user},
-                {"message", m.message},
-                {"timestamp", m.timestamp}
-            });
-        }
-        std::string jsonStr = j.dump(4);
-        std::cout << "[DEBUG] Returning messages JSON (size: " << jsonStr.size() << ")" << std::endl;
-        return buildResponse(jsonStr, "application/json", 200);
-    } else if (req.path == "/peers") {
-        json j = json::array();
-        for (const auto& p : peerDisc.getActivePeers()) {
-            j.push_back({
-                {"id", p.id},
-                {"address", p.address}
-            });
-        }
-        std::string jsonStr = j.dump(4);
-        std::cout << "[DEBUG] Returning peers JSON (size: " << jsonStr.size() << ")" << std::endl;
-        return buildResponse(jsonStr, "application/json", 200);
-    }
-    std::cout << "[DEBUG] 404 for path: " << req.path << std::endl;
-    return buildResponse("Not Found", "text/plain", 404);
+            file = FileHandle::open(path);
+            if (file) {
+                staticFiles[path] = file;
+            } else if (it != staticFiles.end()) {
+                staticFiles.erase(it);
+            }
+        }
+    }
+    if (!file) {
+        res.code = 404;
+        return res;
+    }
+    res.contentType = contentType;
+    res.appendFile(file, 0, file->size());
+    return res;
 }
 
-std::string HttpServer::handlePost(const HttpRequest& req) {
-    std::cout << "[DEBUG] Handling POST for path: " << req.path << " with body: " << req.body.substr(0, 100) << "..." << std::endl;
-    if (req.path == "/messages") {
-        try {
-            json parsed = json::parse(req.body);
-            std::string user = parsed.value("user", "anonymous");
-            std::string message = parsed.value("message", "");
-            if (!message.empty()) {
-                msgHandler.addMessage(user, message);
-                std::cout << "[DEBUG] Message added successfully" << std::endl;
-                return buildResponse("{\"status\": \"ok\"}", "application/json", 200);
-            } else {
-                std::cout << "[DEBUG] Missing message in POST" << std::endl;
-                return buildResponse("{\"error\": \"Missing message\"}", "application/json", 400);
+void HttpServer::serializeResponse(HttpResponse& response, bool keepAlive) {
+    // Only the header block is formatted here; body segments are sent as-is
+    std::pmr::string& head = response.head;
+    head.clear();
+    head.reserve(256);
+    head += "HTTP/1.1 ";
+    head += std::to_string(response.code);
+    head += ' ';
+    head += reasonPhrase(response.code);
+    head += "\r\n";
+    head += "Content-Type: ";
+    head += response.contentType;
+    if (response.chunked) {
+        head += "\r\nTransfer-Encoding: chunked";
+    } else if (!response.streamed()) {
+        head += "\r\nContent-Length: ";
+        head += std::to_string(response.bodySize());
+    }
+    if (!response.allow.empty()) {
+        head += "\r\nAllow: ";
+        head += response.allow;
+    }
+    if (response.retryAfter) {
+        head += "\r\nRetry-After: ";
+        head += std::to_string(response.retryAfter);
+    }
+    head += "\r\n"
+            "Access-Control-Allow-Origin: *\r\n"
+            "Access-Control-Allow-Methods: GET, POST\r\n"
+            "Access-Control-Allow-Headers: Content-Type\r\n";
+    if (keepAlive) {
+        head += "Connection: keep-alive\r\nKeep-Alive: timeout=";
+        head += std::to_string(std::chrono::duration_cast<std::chrono::seconds>(config.keepAliveTimeout).count());
+        head += ", max=";
+        head += std::to_string(config.maxRequestsPerConnection);
+        head += "\r\n\r\n";
+    } else {
+        head += "Connection: close\r\n\r\n";
+    }
+}
+
+HttpResponse HttpServer::handle(const HttpRouter::Match& route, const HttpRequest& req) {
+    switch (route.endpoint) {
+    case HttpRouter::Endpoint::Index: {
+        // Serve files from web/ folder
+        HttpResponse res = buildFileResponse("web/index.html", "text/html");
+        if (res.code == 404) {
+            LOG_ERROR("static_file_missing", {"path", "web/index.html"});
+            return buildResponse("Index file not found", "text/plain", 404);
+        }
+        return res;
+    }
+    case HttpRouter::Endpoint::Style: {
+        HttpResponse res = buildFileResponse("web/style.css", "text/css");
+        if (res.code == 404) return buildResponse("CSS file not found", "text/plain", 404);
+        return res;
+    }
+    case HttpRouter::Endpoint::Script: {
+        HttpResponse res = buildFileResponse("web/app.js", "application/javascript");
+        if (res.code == 404) return buildResponse("JS file not found", "text/plain", 404);
+        return res;
+    }
+    case HttpRouter::Endpoint::Favicon: {
+        HttpResponse res = buildFileResponse("web/favicon.ico", "image/x-icon");
+        if (res.code == 404) return buildResponse("", "image/x-icon", 204);  // Empty to silence browser warnings
+        return res;
+    }
+    case HttpRouter::Endpoint::ListMessages: {
+        HttpResponse res;
+        res.contentType = "application/json";
+        auto body = messagesBody.get(msgHandler.version(), [this] {
+            SingleFlight<std::string>::Versioned built;
+            auto snapshot = msgHandler.snapshot(built.version);
+            // Large histories are streamed per request instead (see below)
+            if (snapshot->size() <= kStreamMessagesAbove) {
+                auto json = std::make_shared<std::string>();
+                JsonEncoder::appendArray(*json, *snapshot);
+                built.value = std::move(json);
             }
-        } catch (const std::exception& e) {
-            std::cerr << "[ERROR] POST parse error: " << e.what() << std::endl;
+            return built;
+        });
+        if (body) {
+            res.appendBody(std::move(body));
+            return res;
+        }
+        auto snapshot = msgHandler.snapshot();
+        LOG_DEBUG("messages_streamed", {"count", snapshot->size()});
+        res.appendStream(std::make_shared<MessageExportStream>(std::move(snapshot)));
+        return res;
+    }
+    case HttpRouter::Endpoint::GetMessage: {
+        auto snapshot = msgHandler.snapshot();
+        auto it = std::find_if(snapshot->begin(), snapshot->end(),
+                               [&route](const Message& m) { return m.id == route.param; });
+        if (it == snapshot->end()) {
+            return buildResponse("{\"error\": \"Message not found\"}", "application/json", 404);
+        }
+        HttpResponse res;
+        res.contentType = "application/json";
+        std::pmr::string body(res.resource());
+        appendJson(body, *it);
+        res.appendBody(std::move(body));
+        return res;
+    }
+    case HttpRouter::Endpoint::Peers: {
+        HttpResponse res;
+        res.contentType = "application/json";
+        auto now = PeerDiscovery::Clock::now();
+        res.appendBody(peersBody.get(peerDisc.version(now), [this, now] {
+            SingleFlight<std::string>::Versioned built;
+            auto json = std::make_shared<std::string>();
+            JsonEncoder::appendArray(*json, peerDisc.getActivePeers(now, built.version));
+            built.value = std::move(json);
+            return built;
+        }));
+        return res;
+    }
+    case HttpRouter::Endpoint::Metrics: {
+        std::string body;
+        renderMetrics(body);
+        return buildResponse(body, "text/plain; version=0.0.4");
+    }
+    case HttpRouter::Endpoint::Traces: {
+        std::string body;
+        renderTraces(req.query, body);
+        return buildResponse(body, "application/json");
+    }
+    case HttpRouter::Endpoint::PostMessage: {
+        JsonFields fields{"user", "message"};
+        std::string_view user = "anonymous";
+        std::string_view message;
+        if (!fields.parse(req.body) || !fields.get("user", user) || !fields.get("message", message)) {
+            LOG_WARN("invalid_json", {"path", req.path}, {"bytes", req.body.size()});
             return buildResponse("{\"error\": \"Invalid JSON\"}", "application/json", 400);
         }
-    } else if (req.path == "/clear") {
+        if (message.empty()) {
+            return buildResponse("{\"error\": \"Missing message\"}", "application/json", 400);
+        }
+        msgHandler.addMessage(std::string(user), std::string(message));
+        return buildResponse("{\"status\": \"ok\"}", "application/json", 200);
+    }
+    case HttpRouter::Endpoint::ImportMessages: {
+        // Only reached without a body; non-empty imports are streamed
+        auto import = streamingHandler(req);
+        import->onData(req.body);
+        return import->finish();
+    }
+    case HttpRouter::Endpoint::Clear:
         msgHandler.clear();
-        std::cout << "[DEBUG] Messages cleared" << std::endl;
+        LOG_INFO("messages_cleared");
         return buildResponse("{\"status\": \"cleared\"}", "application/json", 200);
+    case HttpRouter::Endpoint::None:
+        break;
     }
-    std::cout << "[DEBUG] 404 for POST path: " << req.path << std::endl;
     return buildResponse("Not Found", "text/plain", 404);
-}
\ No newline at end of file
+}
+
+void HttpServer::renderMetrics(std::string& out) {
+    HttpMetrics::instance().render(out);
+
+    auto stats = msgHandler.stats();
+    Metrics::writeHeader(out, "lanchat_messages", "gauge", "Messages in the history.");
+    Metrics::writeSample(out, "lanchat_messages", "", stats.messages);
+    Metrics::writeHeader(out, "lanchat_message_bytes", "gauge", "Text held by the history, excluding JSON framing.");
+    Metrics::writeSample(out, "lanchat_message_bytes", "", stats.bytes);
+    Metrics::writeHeader(out, "lanchat_message_store_written_bytes_total", "counter", "Bytes written to the history file and its log.");
+    Metrics::writeSample(out, "lanchat_message_store_written_bytes_total", "", stats.written);
+    auto saves = msgHandler.saveDurations().snapshot();
+    Metrics::writeHeader(out, "lanchat_message_save_seconds", "histogram", "Time to write and flush a change to the history file or its log.");
+    Metrics::writeHistogram(out, "lanchat_message_save_seconds", "", saves);
+    auto flushes = msgHandler.flushDurations().snapshot();
+    Metrics::writeHeader(out, "lanchat_message_flush_seconds", "histogram", "Time to flush the history file or its log.");
+    Metrics::writeHistogram(out, "lanchat_message_flush_seconds", "", flushes);
+    Metrics::writeHeader(out, "lanchat_message_save_quantile_seconds", "gauge", "Save time quantiles, to within 12.5%.");
+    Metrics::writeQuantiles(out, "lanchat_message_save_quantile_seconds", "", saves);
+
+    Metrics::writeHeader(out, "lanchat_http_shared_bodies_total", "counter",
+                         "GET bodies serialized (built) or reused for an unchanged version (shared), by route; "
+                         "waited counts the shared ones that waited for a concurrent build.");
+    const std::pair<const char*, const SingleFlight<std::string>*> shared[] = {{"/messages", &messagesBody},
+                                                                               {"/peers", &peersBody}};
+    for (const auto& [route, flight] : shared) {
+        auto counts = flight->stats();
+        const std::pair<const char*, uint64_t> results[] = {
+            {"built", counts.builds}, {"shared", counts.shared}, {"waited", counts.waited}};
+        for (const auto& [result, value] : results) {
+            std::string labels = std::string("route=\"") + route + "\",result=\"" + result + "\"";
+            Metrics::writeSample(out, "lanchat_http_shared_bodies_total", labels, value);
+        }
+    }
+
+    Metrics::writeHeader(out, "lanchat_rate_limit_evictions_total", "counter",
+                         "Rate-limit buckets evicted before they refilled because the table was full.");
+    Metrics::writeSample(out, "lanchat_rate_limit_evictions_total", "", rateLimiter.evictions());
+
+    Metrics::writeHeader(out, "lanchat_peers", "gauge", "Peers heard from recently.");
+    Metrics::writeSample(out, "lanchat_peers", "", peerDisc.getActivePeers().size());
+    Metrics::writeHeader(out, "lanchat_log_dropped_total", "counter", "Log records dropped because a thread's ring was full.");
+    Metrics::writeSample(out, "lanchat_log_dropped_total", "", Log::dropped());
+}
+
+void HttpServer::renderTraces(std::string_view query, std::string& out) {
+    size_t limit = 20;
+    if (query.substr(0, 6) == "limit=") {
+        std::from_chars(query.data() + 6, query.data() + query.size(), limit);
+        limit = std::min<size_t>(limit, 1000);
+    }
+    auto events = Trace::collect();
+
+    // Rank requests by their root span and keep every span of the slowest
+    std::vector<std::pair<int64_t, uint64_t>> requests;  // Duration, request id
+    for (const auto& e : events) {
+        if (e.requestId != 0 && std::string_view(e.name) == "request") requests.emplace_back(e.durationNs, e.requestId);
+    }
+    size_t keep = std::min(limit, requests.size());
+    std::partial_sort(requests.begin(), requests.begin() + keep, requests.end(), std::greater<>());
+    std::vector<uint64_t> slowest;
+    for (size_t i = 0; i < keep; ++i) slowest.push_back(requests[i].second);
+    std::sort(slowest.begin(), slowest.end());
+    events.erase(std::remove_if(events.begin(), events.end(), [&](const Trace::Event& e) {
+        return !std::binary_search(slowest.begin(), slowest.end(), e.requestId);
+    }), events.end());
+    Trace::writeChromeJson(out, events);
+}
@@ -2,38 +2,153 @@
 
 #include <string>
 #include <unordered_map>
+#include <map>
+#include <mutex>
+#include <string_view>
 #include <thread>
 #include <atomic>
+#include <memory>
+#include <vector>
+#include <chrono>
 #include "../message/message_handler.hpp"
 #include "../network/peer_discovery.hpp"
 #include "../network/sockets.hpp"
 #include "../util/utils.hpp"
+#include "../util/thread_pool.hpp"
+#include "../util/rate_limiter.hpp"
+#include "../util/single_flight.hpp"
+#include "http_parser.hpp"
+#include "http_response.hpp"
+#include "http_router.hpp"
+#include "http_session.hpp"
 
-struct HttpRequest {
+class EpollReactor;
+class IoUringEngine;
+
+enum class IoMode {
+    Threaded,   // Blocking accept, connections handed to the worker pool
+    Epoll,      // Non-blocking event loops (Linux only, falls back to Threaded)
+    IoUring     // io_uring completion loop (falls back to Epoll)
+};
+
+// Requests per client address to one method and path, e.g. POST /messages
+struct RouteRateLimit {
     std::string method;
     std::string path;
-    std::string body;
-    std::unordered_map<std::string, std::string> headers;
+    RateLimiter::Limit limit;
+};
+
+struct HttpServerConfig {
+    IoMode ioMode = IoMode::Threaded;
+    size_t workerThreads = 0;      // 0 = one per hardware thread
+    size_t maxQueueDepth = 256;    // Accepted connections waiting for a worker; beyond this they get a 503
+    size_t maxConnections = 0;     // Open connections, queued ones included; beyond this new ones get a 503. 0 = no limit
+    int listenBacklog = SOMAXCONN;  // Connections the kernel completes before accept(); further SYNs are dropped
+    std::chrono::seconds retryAfter{1};  // Retry-After sent with admission-control 503s
+    RateLimiter::Limit connectionRate;         // New connections per client address; a 429 beyond
+    std::vector<RouteRateLimit> requestRates;  // A 429 beyond, sent before the body is read
+    size_t eventLoops = 1;         // Epoll mode: number of event-loop threads
+    bool reusePort = false;        // Epoll mode: one SO_REUSEPORT listener per loop
+    bool pinEventLoops = false;    // Epoll mode: pin loop i to core i
+    std::chrono::milliseconds requestTimeout{5000};    // Max time to receive a request's headers, from connect or first byte
+    std::chrono::milliseconds bodyTimeout{5000};       // Max gap between pieces of a request body
+    std::chrono::milliseconds keepAliveTimeout{5000};  // Idle time allowed between requests
+    std::chrono::milliseconds sendTimeout{10000};      // Max time a response may make no progress
+    size_t maxRequestsPerConnection = 100;
+    uint64_t maxBodySize = 1024 * 1024;               // Bodies buffered for ordinary handlers
+    uint64_t maxStreamedBodySize = 64 * 1024 * 1024;  // Bodies consumed incrementally (e.g. /messages/import)
 };
 
 class HttpServer {
+    friend class EpollReactor;
+    friend class IoUringEngine;
 public:
-    HttpServer(int port, MessageHandler& msgHandler, PeerDiscovery& peerDisc);
+    HttpServer(int port, MessageHandler& msgHandler, PeerDiscovery& peerDisc,
+               const HttpServerConfig& config = HttpServerConfig());
     ~HttpServer();
     void start();
     void stop();
+    ThreadPool::Stats poolStats() const;
 private:
     void serverLoop();
-    void handleClient(SOCKET clientSock);
-    HttpRequest parseRequest(const std::string& raw);
-    std::string buildResponse(const std::string& body, const std::string& contentType = "application/json", int code = 200);
-    std::string handleGet(const HttpRequest& req);
-    std::string handlePost(const HttpRequest& req);
+    bool reusePortEnabled() const;
+    void handleClient(SOCKET clientSock, uint32_t client);
+    // Admission control. admit() takes a connection slot, failing at
+    // maxConnections; every admitted connection calls release() when closed.
+    // shed() answers a connection that was not admitted, or could not be
+    // queued, with a canned 503 and closes it without reading the request.
+    bool admit();
+    void release() { openConnections.fetch_sub(1, std::memory_order_relaxed); }
+    void shed(SOCKET fd, HttpMetrics::Shed reason);
+    // Per-client rate limits; both return 0 to go ahead, else the seconds
+    // for Retry-After. Routes without a limit cost nothing.
+    uint32_t limitConnection(uint32_t client);
+    bool limitsClients() const { return config.connectionRate.enabled() || !routeLimits.empty(); }
+    uint32_t limitRequest(const HttpSession& session, const HttpRequest& req);
+    void pushLimited(ResponseQueue& out, const HttpRequest& req, uint32_t retryAfter, bool keepAlive);
+    // Timeouts. Each connection waits in one phase at a time (headers, body,
+    // keep-alive idle, or a response being sent), and the phase's timeout
+    // runs from entering it; engines restart it on body or send progress by
+    // setting session.waitingSince. deadline() notes phase changes and
+    // returns when the connection should be closed; timedOut() records one
+    // that was.
+    std::chrono::steady_clock::time_point deadline(HttpSession& session, bool writing,
+                                                   std::chrono::steady_clock::time_point now) const;
+    void timedOut(const HttpSession& session) const;
+    // Consumes complete requests from the front of session.in, appending their
+    // responses to session.out, and feeds streaming bodies to their handler.
+    // Returns false once the connection should close. The session carries
+    // partial-request state between calls.
+    bool serveBuffered(HttpSession& session);
+    void pushError(ResponseQueue& out, int code);
+    void pushContinue(ResponseQueue& out);
+    static bool expectsContinue(const HttpRequest& req);
+    // Handler for routes that consume their body incrementally, or null
+    std::unique_ptr<BodyHandler> streamingHandler(const HttpRequest& req);
+    HttpResponse finishUpload(BodyHandler& handler);
+    // Handles one parsed request and returns the serialized response. keepAlive
+    // says whether the connection may stay open and is cleared when it won't.
+    HttpResponse processRequest(const HttpRequest& req, bool& keepAlive, uint64_t rid);
+    // Closes the request's root trace span; nextArrived says the following
+    // request is already buffered, so its read starts now
+    void endRequest(HttpSession& session, uint64_t rid, bool nextArrived);
+    static bool wantsKeepAlive(const HttpRequest& req);
+    HttpResponse buildResponse(std::string_view body, std::string_view contentType = "application/json", int code = 200);
+    // Static files are sent straight from the file descriptor; code is 404 if missing
+    HttpResponse buildFileResponse(const char* path, std::string_view contentType);
+    void serializeResponse(HttpResponse& response, bool keepAlive);
+    // Runs the endpoint HttpRouter matched
+    HttpResponse handle(const HttpRouter::Match& route, const HttpRequest& req);
+    // Prometheus text format for GET /metrics
+    void renderMetrics(std::string& out);
+    // Chrome trace JSON of the slowest requests still in the trace rings
+    void renderTraces(std::string_view query, std::string& out);
 
     int port;
     MessageHandler& msgHandler;
     PeerDiscovery& peerDisc;
+    HttpServerConfig config;
+    std::unique_ptr<ThreadPool> pool;
+#ifdef __linux__
+    std::unique_ptr<EpollReactor> reactor;
+#endif
+#ifdef LANCHAT_HAVE_IO_URING
+    std::unique_ptr<IoUringEngine> uring;
+#endif
     std::atomic<bool> running{false};
+    std::atomic<uint64_t> nextRequestId{1};  // For correlating log lines and trace spans
+    std::atomic<size_t> openConnections{0};
+    std::string shedResponse;
+    std::string limitedResponse;  // Canned 429 for connections over connectionRate
+    RateLimiter rateLimiter;
+    std::vector<RateLimiter::Limit> routeLimits;  // By HttpMetrics method and route; empty if none is set
+    // GET /messages and /peers bodies, serialized once per version of the
+    // data and shared by every request that wants that version
+    SingleFlight<std::string> messagesBody;
+    SingleFlight<std::string> peersBody;
     std::thread serverTh;
     TCPServer tcpServer;
+    std::vector<std::unique_ptr<TCPServer>> shardServers;  // Extra SO_REUSEPORT listeners
+    std::mutex staticFilesMutex;
+    std::map<std::string, std::shared_ptr<const FileHandle>, std::less<>> staticFiles;
 };
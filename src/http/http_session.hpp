@@ -0,0 +1,50 @@
+#pragma once
+
+#include <memory>
+#include <chrono>
+#include <cstddef>
+#include "http_parser.hpp"
+#include "http_response.hpp"
+#include "http_body.hpp"
+#include "http_metrics.hpp"
+#include "../util/trace.hpp"
+#include "../util/buffer_pool.hpp"
+
+// Consumes a request body as it arrives instead of having it buffered.
+// Created once the request's headers are parsed; they are gone by the time
+// data arrives, so anything needed from them must be copied up front.
+class BodyHandler : public BodySink {
+public:
+    virtual HttpResponse finish() = 0;  // Called after the last body byte
+};
+
+// Per-connection HTTP state, shared by every I/O engine and driven by
+// HttpServer::serveBuffered.
+struct HttpSession {
+    HttpSession() { HttpMetrics::instance().connectionOpened(); }
+    ~HttpSession() { HttpMetrics::instance().connectionClosed(); }
+    HttpSession(const HttpSession&) = delete;
+    HttpSession& operator=(const HttpSession&) = delete;
+
+    RecvBuffer in;
+    ResponseQueue out;
+    HttpParser parser;
+    size_t served = 0;
+    uint32_t client = 0;  // Peer IPv4 address in host order, 0 if unknown
+
+    // What the connection is waiting for, since when, and how many requests
+    // had been served then; see HttpServer::deadline
+    HttpMetrics::Timeout waiting = HttpMetrics::Timeout::Header;
+    std::chrono::steady_clock::time_point waitingSince = std::chrono::steady_clock::now();
+    size_t waitingServed = 0;
+
+    // First bytes of the request being read arrived at readStarted
+    bool reading = false;
+    Trace::Clock::time_point readStarted;
+    uint64_t requestId = 0;  // Of the request whose body is streaming
+
+    // Set while a streaming request body is being received
+    std::unique_ptr<BodyHandler> upload;
+    BodyDecoder uploadBody;
+    bool uploadKeepAlive = false;
+};
@@ -0,0 +1,412 @@
+#ifdef LANCHAT_HAVE_IO_URING
+
+#include "io_uring_engine.hpp"
+#include "http_server.hpp"
+#include "../util/log.hpp"
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+
+namespace {
+const unsigned kRingEntries = 1024;
+const size_t kFixedBuffers = 256;
+const size_t kBufSize = 16384;
+
+int sysSetup(unsigned entries, io_uring_params* p) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, p));
+}
+
+int sysEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0));
+}
+
+int sysRegister(int fd, unsigned opcode, const void* arg, unsigned nrArgs) {
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, nrArgs));
+}
+
+template <typename T> T* offsetPtr(void* base, unsigned off) {
+    return reinterpret_cast<T*>(static_cast<char*>(base) + off);
+}
+}
+
+IoUringEngine::IoUringEngine(HttpServer& srv) : server(srv) {}
+
+IoUringEngine::~IoUringEngine() {
+    for (auto& [fd, _] : conns) {
+        CLOSE_SOCKET(fd);
+        server.release();
+    }
+    // Closing the ring tears down any remaining requests and unpins the
+    // registered buffers, so the pool is only freed afterwards
+    if (ringFd >= 0) ::close(ringFd);
+    if (sqes) munmap(sqes, sqesSize);
+    if (cqRingPtr && cqRingPtr != sqRingPtr) munmap(cqRingPtr, cqRingSize);
+    if (sqRingPtr) munmap(sqRingPtr, sqRingSize);
+    if (wakeFd >= 0) ::close(wakeFd);
+    std::free(fixedPool);
+}
+
+bool IoUringEngine::init() {
+    io_uring_params p{};
+    ringFd = sysSetup(kRingEntries, &p);
+    if (ringFd < 0) {
+        LOG_WARN("io_uring_setup_failed", {"error", std::strerror(errno)});
+        return false;
+    }
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP)) {
+        LOG_WARN("io_uring_setup_failed", {"error", "kernel too old (no single mmap)"});
+        return false;
+    }
+
+    sqRingSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cqRingSize = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    if (cqRingSize > sqRingSize) sqRingSize = cqRingSize;
+    cqRingSize = sqRingSize;
+    sqRingPtr = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     ringFd, IORING_OFF_SQ_RING);
+    if (sqRingPtr == MAP_FAILED) {
+        sqRingPtr = nullptr;
+        return false;
+    }
+    cqRingPtr = sqRingPtr;
+
+    sqesSize = p.sq_entries * sizeof(io_uring_sqe);
+    void* s = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   ringFd, IORING_OFF_SQES);
+    if (s == MAP_FAILED) return false;
+    sqes = static_cast<io_uring_sqe*>(s);
+
+    sqHead = offsetPtr<unsigned>(sqRingPtr, p.sq_off.head);
+    sqTail = offsetPtr<unsigned>(sqRingPtr, p.sq_off.tail);
+    sqMask = offsetPtr<unsigned>(sqRingPtr, p.sq_off.ring_mask);
+    sqArray = offsetPtr<unsigned>(sqRingPtr, p.sq_off.array);
+    sqEntries = p.sq_entries;
+    cqHead = offsetPtr<unsigned>(cqRingPtr, p.cq_off.head);
+    cqTail = offsetPtr<unsigned>(cqRingPtr, p.cq_off.tail);
+    cqMask = offsetPtr<unsigned>(cqRingPtr, p.cq_off.ring_mask);
+    cqes = offsetPtr<io_uring_cqe>(cqRingPtr, p.cq_off.cqes);
+    backlog.reserve(p.cq_entries);
+    handling.reserve(p.cq_entries);
+
+    // Registered receive buffers; the kernel pins these once instead of
+    // mapping user pages on every read
+    fixedPool = static_cast<char*>(std::aligned_alloc(4096, kFixedBuffers * kBufSize));
+    std::vector<iovec> iovs(kFixedBuffers);
+    for (size_t i = 0; i < kFixedBuffers; ++i) {
+        iovs[i].iov_base = fixedPool + i * kBufSize;
+        iovs[i].iov_len = kBufSize;
+        freeFixed.push_back(static_cast<int>(kFixedBuffers - 1 - i));
+    }
+    if (sysRegister(ringFd, IORING_REGISTER_BUFFERS, iovs.data(), kFixedBuffers) < 0) {
+        LOG_WARN("io_uring_fixed_buffers_unavailable", {"using", "plain recv"});
+        freeFixed.clear();
+    }
+
+    wakeFd = eventfd(0, EFD_CLOEXEC);
+    auto tick = std::chrono::duration_cast<std::chrono::nanoseconds>(timers.tick()).count();
+    tickTs.tv_sec = tick / 1000000000;
+    tickTs.tv_nsec = tick % 1000000000;
+    return wakeFd >= 0;
+}
+
+void IoUringEngine::run(SOCKET listenFd) {
+    queueAccept(listenFd);
+    queueWake();
+    while (!stopping) {
+        if (!submitAndWait(1)) break;
+        reapCompletions(listenFd);
+    }
+    queueCancel(pack(Op::Accept, listenFd));
+    drain(listenFd);
+}
+
+void IoUringEngine::reapCompletions(SOCKET listenFd) {
+    // Handlers queue new requests, and getSqe() may stash more completions
+    // into backlog while they do
+    while (true) {
+        if (backlog.empty()) stashCompletions();
+        if (backlog.empty()) return;
+        handling.swap(backlog);
+        for (const io_uring_cqe& cqe : handling) handleCompletion(cqe, listenFd);
+        handling.clear();
+    }
+}
+
+void IoUringEngine::stashCompletions() {
+    unsigned head = *cqHead;
+    unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) backlog.push_back(cqes[head & *cqMask]);
+    __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+}
+
+void IoUringEngine::handleCompletion(const io_uring_cqe& cqe, SOCKET listenFd) {
+    if (!(cqe.flags & IORING_CQE_F_MORE)) inflight--;
+
+    Op op = static_cast<Op>(cqe.user_data & 0xff);
+    int fd = static_cast<int>(cqe.user_data >> 8);
+    switch (op) {
+    case Op::Accept:
+        onAccept(cqe.res, cqe.flags, listenFd);
+        break;
+    case Op::Recv:
+    case Op::Send: {
+        auto it = conns.find(fd);
+        if (it == conns.end()) break;
+        if (op == Op::Recv) onRecv(it->second, cqe.res);
+        else onSend(it->second, cqe.res);
+        break;
+    }
+    case Op::Tick:
+        tickQueued = false;
+        timers.advance(std::chrono::steady_clock::now(), [this](TimerWheel::Timer& timer) {
+            expire(static_cast<int>(timer.data));
+        });
+        if (timers.size() && !stopping) queueTick();
+        break;
+    case Op::Wake:
+    case Op::Cancel:
+        break;
+    }
+}
+
+void IoUringEngine::stop() {
+    stopping = true;
+    uint64_t one = 1;
+    if (wakeFd >= 0 && ::write(wakeFd, &one, sizeof(one)) < 0) {
+        LOG_ERROR("io_uring_wake_failed", {"errno", errno});
+    }
+}
+
+io_uring_sqe* IoUringEngine::getSqe() {
+    unsigned tail = *sqTail;
+    // A full queue must be taken by the kernel before a slot is reused; while
+    // its completion queue is backed up it refuses, so move completions off
+    while (tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries) {
+        if (!submitAndWait(0)) {
+            // The loop is shutting down; the caller's request goes nowhere
+            std::memset(&discarded, 0, sizeof(discarded));
+            return &discarded;
+        }
+        stashCompletions();
+    }
+    unsigned idx = tail & *sqMask;
+    sqArray[idx] = idx;
+    // Without SQPOLL the kernel only reads the ring inside io_uring_enter, so
+    // publishing the tail before the caller fills the SQE is safe
+    __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+    pendingSubmit++;
+    inflight++;
+    io_uring_sqe* sqe = &sqes[idx];
+    std::memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+bool IoUringEngine::submitAndWait(unsigned waitNr) {
+    while (true) {
+        int ret = sysEnter(ringFd, pendingSubmit, waitNr, waitNr ? IORING_ENTER_GETEVENTS : 0);
+        if (ret >= 0) {
+            pendingSubmit -= std::min(static_cast<unsigned>(ret), pendingSubmit);
+            return true;
+        }
+        if (errno == EINTR) continue;
+        // The completion queue is backed up (EBUSY) or the kernel is short of
+        // memory (EAGAIN): nothing was submitted. Making room is the caller's
+        // next step, and waiting here could block with completions unhandled.
+        if (errno == EAGAIN || errno == EBUSY) {
+            stashCompletions();
+            return true;
+        }
+        LOG_ERROR("io_uring_enter_failed", {"error", std::strerror(errno)});
+        stopping = true;
+        return false;
+    }
+}
+
+void IoUringEngine::queueAccept(SOCKET listenFd) {
+    io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listenFd;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    if (multishotAccept) sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = pack(Op::Accept, listenFd);
+}
+
+void IoUringEngine::queueRecv(Connection& conn) {
+    io_uring_sqe* sqe = getSqe();
+    sqe->fd = conn.fd;
+    sqe->user_data = pack(Op::Recv, conn.fd);
+    if (conn.fixedBuf >= 0) {
+        sqe->opcode = IORING_OP_READ_FIXED;
+        sqe->addr = reinterpret_cast<uint64_t>(fixedPool + conn.fixedBuf * kBufSize);
+        sqe->len = kBufSize;
+        sqe->buf_index = static_cast<uint16_t>(conn.fixedBuf);
+    } else {
+        if (conn.heapBuf.empty()) conn.heapBuf.resize(kBufSize);
+        sqe->opcode = IORING_OP_RECV;
+        sqe->addr = reinterpret_cast<uint64_t>(conn.heapBuf.data());
+        sqe->len = conn.heapBuf.size();
+    }
+}
+
+void IoUringEngine::queueSend(Connection& conn) {
+    conn.msg = msghdr{};
+    conn.msg.msg_iov = conn.iov;
+    conn.msg.msg_iovlen = conn.http.out.gather(conn.iov, kSendIov);
+    io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = conn.fd;
+    sqe->addr = reinterpret_cast<uint64_t>(&conn.msg);
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = pack(Op::Send, conn.fd);
+}
+
+void IoUringEngine::queueWake() {
+    io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = wakeFd;
+    sqe->addr = reinterpret_cast<uint64_t>(&wakeValue);
+    sqe->len = sizeof(wakeValue);
+    sqe->user_data = pack(Op::Wake, 0);
+}
+
+void IoUringEngine::queueTick() {
+    tickQueued = true;
+    io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->addr = reinterpret_cast<uint64_t>(&tickTs);
+    sqe->len = 1;
+    sqe->user_data = pack(Op::Tick, 0);
+}
+
+void IoUringEngine::queueCancel(uint64_t target) {
+    io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = target;
+    sqe->user_data = pack(Op::Cancel, 0);
+}
+
+void IoUringEngine::onAccept(int res, uint32_t flags, SOCKET listenFd) {
+    if (res >= 0) {
+        // Multishot accept reports no address, so it is only looked up when a limit needs it
+        uint32_t client = server.limitsClients() ? SocketUtils::peerAddress(res) : 0;
+        if (stopping) {
+            CLOSE_SOCKET(res);
+        } else if (server.limitConnection(client)) {
+            server.shed(res, HttpMetrics::Shed::ClientRate);
+        } else if (!server.admit()) {
+            server.shed(res, HttpMetrics::Shed::Connections);
+        } else {
+            Connection& conn = conns[res];
+            conn.fd = res;
+            conn.http.client = client;
+            conn.timeout.data = static_cast<uint64_t>(res);
+            if (!freeFixed.empty()) {
+                conn.fixedBuf = freeFixed.back();
+                freeFixed.pop_back();
+            }
+            queueRecv(conn);
+            armTimeout(conn);
+        }
+    } else if (stopping) {
+        // Listener was shut down or the accept cancelled
+    } else if (res == -EINVAL && multishotAccept) {
+        LOG_INFO("io_uring_multishot_accept_unsupported", {"using", "single-shot accept"});
+        multishotAccept = false;
+    } else {
+        LOG_ERROR("accept_failed", {"error", std::strerror(-res)});
+    }
+    if (!(flags & IORING_CQE_F_MORE) && !stopping) queueAccept(listenFd);
+}
+
+void IoUringEngine::onRecv(Connection& conn, int res) {
+    if (res == -EINTR || res == -EAGAIN) {
+        queueRecv(conn);
+        return;
+    }
+    if (res <= 0 || conn.closing) {
+        closeConnection(conn);
+        return;
+    }
+    const char* data = conn.fixedBuf >= 0 ? fixedPool + conn.fixedBuf * kBufSize : conn.heapBuf.data();
+    conn.http.in.append(data, res);
+    if (conn.http.waiting == HttpMetrics::Timeout::Body) conn.http.waitingSince = std::chrono::steady_clock::now();
+
+    conn.keepOpen = server.serveBuffered(conn.http);
+    if (conn.http.out.empty()) {
+        queueRecv(conn);
+    } else {
+        conn.writing = true;
+        queueSend(conn);
+    }
+    armTimeout(conn);
+}
+
+void IoUringEngine::onSend(Connection& conn, int res) {
+    if (res == -EINTR || res == -EAGAIN) {
+        queueSend(conn);
+        return;
+    }
+    if (res <= 0 || conn.closing) {  // Zero means gather() could not load a file range
+        closeConnection(conn);
+        return;
+    }
+    conn.http.out.consume(res);
+    if (!conn.http.out.empty()) {
+        conn.http.waitingSince = std::chrono::steady_clock::now();  // Send progress
+        queueSend(conn);
+        armTimeout(conn);
+        return;
+    }
+    conn.writing = false;
+    if (!conn.keepOpen) {
+        closeConnection(conn);
+        return;
+    }
+    queueRecv(conn);
+    armTimeout(conn);
+}
+
+void IoUringEngine::closeConnection(Connection& conn) {
+    if (conn.fixedBuf >= 0) freeFixed.push_back(conn.fixedBuf);
+    int fd = conn.fd;
+    CLOSE_SOCKET(fd);
+    conns.erase(fd);
+    server.release();
+}
+
+void IoUringEngine::armTimeout(Connection& conn) {
+    timers.schedule(conn.timeout, server.deadline(conn.http, conn.writing, std::chrono::steady_clock::now()));
+    if (!tickQueued && !stopping) queueTick();
+}
+
+void IoUringEngine::expire(int fd) {
+    // A connection always has exactly one request in flight, so it cannot be
+    // closed here; shutting it down makes that request complete and the
+    // completion handler releases it
+    auto it = conns.find(fd);
+    if (it == conns.end() || it->second.closing) return;
+    server.timedOut(it->second.http);
+    it->second.closing = true;
+    ::shutdown(fd, SHUT_RDWR);
+}
+
+void IoUringEngine::drain(SOCKET listenFd) {
+    for (auto& [fd, conn] : conns) {
+        conn.closing = true;
+        ::shutdown(fd, SHUT_RDWR);
+    }
+    // Every handler releases its connection once stopping is set, and a
+    // queued tick times out within one wheel tick
+    while (inflight > 0) {
+        if (!submitAndWait(1)) break;
+        reapCompletions(listenFd);
+    }
+}
+
+#endif
@@ -0,0 +1,112 @@
+#pragma once
+
+#ifdef LANCHAT_HAVE_IO_URING
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <linux/io_uring.h>
+#include "../network/sockets.hpp"
+#include "../util/timer_wheel.hpp"
+#include "http_session.hpp"
+
+class HttpServer;
+
+// io_uring-driven I/O engine. Talks to the kernel through the raw syscalls so
+// no liburing dependency is needed. A single multishot accept feeds the ring,
+// receives go into a pool of registered (fixed) buffers where available, and
+// all SQEs queued while handling a batch of completions are submitted with a
+// single io_uring_enter call. Request handling is shared with the other modes
+// via HttpServer::processRequest. Connection timeouts live in a timer wheel
+// driven by a ring timeout that is only queued while a timer is armed.
+class IoUringEngine {
+public:
+    explicit IoUringEngine(HttpServer& server);
+    ~IoUringEngine();
+    bool init();                // False when the kernel refuses io_uring
+    void run(SOCKET listenFd);  // Blocks until stop()
+    void stop();
+private:
+    enum class Op : uint8_t { Accept = 1, Recv, Send, Wake, Tick, Cancel };
+
+    static const size_t kSendIov = 16;
+
+    struct Connection {
+        SOCKET fd = INVALID_SOCKET;
+        int fixedBuf = -1;          // Index into the registered buffer pool
+        std::vector<char> heapBuf;  // Used when the pool is exhausted
+        HttpSession http;
+        // The kernel reads these when the SENDMSG executes, so they live with
+        // the connection rather than on the stack
+        msghdr msg{};
+        iovec iov[kSendIov];
+        bool keepOpen = true;
+        bool writing = false;
+        bool closing = false;
+        TimerWheel::Timer timeout;  // data is the fd
+    };
+
+    io_uring_sqe* getSqe();
+    // False once the ring is unusable; stopping is set
+    bool submitAndWait(unsigned waitNr);
+    void reapCompletions(SOCKET listenFd);
+    void stashCompletions();
+    void handleCompletion(const io_uring_cqe& cqe, SOCKET listenFd);
+    void queueAccept(SOCKET listenFd);
+    void queueRecv(Connection& conn);
+    void queueSend(Connection& conn);
+    void queueWake();
+    void queueTick();
+    void queueCancel(uint64_t target);
+    void onAccept(int res, uint32_t flags, SOCKET listenFd);
+    void onRecv(Connection& conn, int res);
+    void onSend(Connection& conn, int res);
+    void closeConnection(Connection& conn);
+    void armTimeout(Connection& conn);
+    void expire(int fd);
+    void drain(SOCKET listenFd);
+
+    static uint64_t pack(Op op, int fd) { return (static_cast<uint64_t>(fd) << 8) | static_cast<uint8_t>(op); }
+
+    HttpServer& server;
+    int ringFd = -1;
+    void* sqRingPtr = nullptr;
+    void* cqRingPtr = nullptr;
+    size_t sqRingSize = 0;
+    size_t cqRingSize = 0;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqesSize = 0;
+    unsigned* sqHead = nullptr;
+    unsigned* sqTail = nullptr;
+    unsigned* sqMask = nullptr;
+    unsigned* sqArray = nullptr;
+    unsigned sqEntries = 0;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned* cqMask = nullptr;
+    io_uring_cqe* cqes = nullptr;
+    unsigned pendingSubmit = 0;
+    size_t inflight = 0;
+    // Completions taken off the ring, unhandled, so the kernel could accept
+    // more submissions; swapped into handling by reapCompletions
+    std::vector<io_uring_cqe> backlog;
+    std::vector<io_uring_cqe> handling;
+    io_uring_sqe discarded{};  // Handed out once the ring has failed
+
+    char* fixedPool = nullptr;
+    std::vector<int> freeFixed;
+    int wakeFd = -1;
+    uint64_t wakeValue = 0;
+    __kernel_timespec tickTs{};
+    bool tickQueued = false;
+    bool multishotAccept = true;
+
+    std::unordered_map<int, Connection> conns;
+    TimerWheel timers;
+    std::atomic<bool> stopping{false};
+};
+
+#endif
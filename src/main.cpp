@@ -1,18 +1,147 @@
 #include "message/message_handler.hpp"
 #include "network/peer_discovery.hpp"
 #include "http/http_server.hpp"
+#include "util/log.hpp"
+#include "util/trace.hpp"
+#include <charconv>
+#include <climits>
+#include <cstdint>
 #include <iostream>
+#include <string>
+
+namespace {
+
+// The whole of text as an integer from min to max
+template <typename T>
+bool parseNumber(const std::string& text, T min, T max, T& value) {
+    T parsed{};
+    const char* end = text.data() + text.size();
+    auto result = std::from_chars(text.data(), end, parsed);
+    if (result.ec != std::errc() || result.ptr != end || parsed < min || parsed > max) return false;
+    value = parsed;
+    return true;
+}
+
+int badValue(const std::string& flag, const char* expected) {
+    std::cerr << flag << " takes " << expected << "\n";
+    return 1;
+}
+
+// "RATE" or "RATE/BURST", in requests per second
+bool parseLimit(const std::string& text, RateLimiter::Limit& limit) {
+    try {
+        size_t slash = text.find('/');
+        limit.perSecond = std::stod(text.substr(0, slash));
+        limit.burst = slash == std::string::npos ? 1 : std::stod(text.substr(slash + 1));
+    } catch (const std::exception&) {
+        return false;
+    }
+    return limit.perSecond > 0 && limit.burst >= 1;
+}
+
+// "METHOD:PATH=RATE[/BURST]", e.g. POST:/messages=2/10
+bool parseRouteLimit(const std::string& text, RouteRateLimit& rule) {
+    size_t colon = text.find(':');
+    size_t equals = text.find('=');
+    if (colon == std::string::npos || equals == std::string::npos || equals < colon) return false;
+    rule.method = text.substr(0, colon);
+    rule.path = text.substr(colon + 1, equals - colon - 1);
+    return parseLimit(text.substr(equals + 1), rule.limit);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    int port = 8080;
+    HttpServerConfig config;
+    StoreMode storeMode = StoreMode::Rewrite;
+    bool syncWrites = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--port" && i + 1 < argc) {
+            if (!parseNumber(argv[++i], 1, 65535, port)) return badValue(arg, "a port from 1 to 65535");
+        } else if (arg == "--io" && i + 1 < argc) {
+            std::string mode = argv[++i];
+            if (mode == "threaded") config.ioMode = IoMode::Threaded;
+            else if (mode == "epoll") config.ioMode = IoMode::Epoll;
+            else if (mode == "uring") config.ioMode = IoMode::IoUring;
+            else return badValue(arg, "threaded, epoll or uring");
+        } else if (arg == "--event-loops" && i + 1 < argc) {
+            if (!parseNumber<size_t>(argv[++i], 1, 1024, config.eventLoops)) return badValue(arg, "a count from 1 to 1024");
+        } else if (arg == "--reuseport") {
+            config.reusePort = true;
+        } else if (arg == "--pin-loops") {
+            config.pinEventLoops = true;
+        } else if (arg == "--workers" && i + 1 < argc) {
+            if (!parseNumber<size_t>(argv[++i], 0, 4096, config.workerThreads)) {
+                return badValue(arg, "a count from 0 (one per core) to 4096");
+            }
+        } else if (arg == "--queue-depth" && i + 1 < argc) {
+            if (!parseNumber<size_t>(argv[++i], 1, SIZE_MAX, config.maxQueueDepth)) return badValue(arg, "a count of 1 or more");
+        } else if (arg == "--max-connections" && i + 1 < argc) {
+            if (!parseNumber<size_t>(argv[++i], 0, SIZE_MAX, config.maxConnections)) {
+                return badValue(arg, "a count, or 0 for no limit");
+            }
+        } else if (arg == "--backlog" && i + 1 < argc) {
+            if (!parseNumber(argv[++i], 1, INT_MAX, config.listenBacklog)) return badValue(arg, "a count of 1 or more");
+        } else if (arg == "--retry-after" && i + 1 < argc) {
+            int seconds = 0;
+            if (!parseNumber(argv[++i], 0, 86400, seconds)) return badValue(arg, "seconds from 0 to 86400");
+            config.retryAfter = std::chrono::seconds(seconds);
+        } else if (arg == "--conn-rate" && i + 1 < argc) {
+            if (!parseLimit(argv[++i], config.connectionRate)) {
+                std::cerr << "--conn-rate takes RATE or RATE/BURST\n";
+                return 1;
+            }
+        } else if (arg == "--rate-limit" && i + 1 < argc) {
+            RouteRateLimit rule;
+            if (!parseRouteLimit(argv[++i], rule)) {
+                std::cerr << "--rate-limit takes METHOD:PATH=RATE or METHOD:PATH=RATE/BURST\n";
+                return 1;
+            }
+            config.requestRates.push_back(rule);
+        } else if (arg == "--max-body" && i + 1 < argc) {
+            if (!parseNumber<uint64_t>(argv[++i], 0, UINT64_MAX, config.maxBodySize)) return badValue(arg, "a size in bytes");
+        } else if (arg == "--log-level" && i + 1 < argc) {
+            Log::Level level;
+            if (!Log::parseLevel(argv[++i], level)) {
+                std::cerr << "Unknown log level: " << argv[i] << "\n";
+                return 1;
+            }
+            Log::setLevel(level);
+        } else if (arg == "--store" && i + 1 < argc) {
+            std::string mode = argv[++i];
+            if (mode == "rewrite") storeMode = StoreMode::Rewrite;
+            else if (mode == "log") storeMode = StoreMode::AppendLog;
+            else if (mode == "group") storeMode = StoreMode::GroupCommit;
+            else return badValue(arg, "rewrite, log or group");
+        } else if (arg == "--fsync") {
+            syncWrites = true;
+        } else if (arg == "--no-trace") {
+            Trace::setEnabled(false);
+        } else {
+            std::cerr << "Unknown option or missing value: " << arg << "\n";
+            return 1;
+        }
+    }
+
+    if (config.reusePort && config.ioMode != IoMode::Epoll) {
+        std::cerr << "--reuseport needs --io epoll\n";
+        return 1;
+    }
+    if (config.reusePort && config.eventLoops < 2) {
+        std::cerr << "Warning: --reuseport has no effect with fewer than 2 --event-loops\n";
+    }
 
-int main() {
     try {
-        MessageHandler msgHandler("messages.json");
+        MessageHandler msgHandler("messages.json", storeMode, syncWrites);
         PeerDiscovery peerDiscovery;
-        HttpServer server(8080, msgHandler, peerDiscovery);
+        HttpServer server(port, msgHandler, peerDiscovery, config);
 
         peerDiscovery.start();
         server.start();
 
-        std::cout << "LAN Chat app running on http://localhost:8080. Press Enter to stop...\n";
+        std::cout << "LAN Chat app running on http://localhost:" << port << ". Press Enter to stop...\n";
         std::cin.get();
 
         server.stop();
@@ -22,4 +151,4 @@ int main() {
         return 1;
     }
     return 0;
-}
\ No newline at end of file
+}
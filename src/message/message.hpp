@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include "../util/json_encoder.hpp"
 
 struct Message {
     std::string id;
@@ -14,3 +15,17 @@ struct Message {
     void generateId();
     void generateTimestamp();
 };
+
+// Keys in sorted order, matching what nlohmann::json writes
+template <class Out>
+void appendJson(Out& out, const Message& m) {
+    out += "{\"id\":";
+    JsonEncoder::appendString(out, m.id);
+    out += ",\"message\":";
+    JsonEncoder::appendString(out, m.message);
+    out += ",\"timestamp\":";
+    JsonEncoder::appendString(out, m.timestamp);
+    out += ",\"user\":";
+    JsonEncoder::appendString(out, m.user);
+    out += '}';
+}
@@ -1,83 +1,402 @@
 #include "message_handler.hpp"
 #include <fstream>
-#include <iostream>
+#include "../util/log.hpp"
+#include "../util/trace.hpp"
 #include <nlohmann/json.hpp>
+#include <algorithm>
+#include <chrono>
 #include <exception>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
 #include <mutex>
+#include <fcntl.h>
+#ifdef _WIN32
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <unistd.h>
+#endif
 
 using json = nlohmann::json;
 
-MessageHandler::MessageHandler(const std::string& file) : filename(file) {
+namespace {
+
+// A log shorter than this is never folded into the file, whatever its size
+const uint64_t kMinCompactBytes = 1024 * 1024;
+
+int openFile(const std::string& path, bool truncate) {
+    int flags = O_WRONLY | O_CREAT | (truncate ? O_TRUNC : O_APPEND);
+#ifdef _WIN32
+    return ::_open(path.c_str(), flags | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    return ::open(path.c_str(), flags | O_CLOEXEC, 0644);
+#endif
+}
+
+bool writeAll(int fd, const std::string& data) {
+    size_t done = 0;
+    while (done < data.size()) {
+#ifdef _WIN32
+        int n = ::_write(fd, data.data() + done, static_cast<unsigned>(data.size() - done));
+#else
+        ssize_t n = ::write(fd, data.data() + done, data.size() - done);
+#endif
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        done += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// Waits until the data written to fd is on disk, not just in the page cache
+bool syncFile(int fd) {
+#ifdef _WIN32
+    return ::_commit(fd) == 0;
+#elif defined(__linux__)
+    return ::fdatasync(fd) == 0;
+#else
+    return ::fsync(fd) == 0;
+#endif
+}
+
+bool closeFile(int fd) {
+#ifdef _WIN32
+    return ::_close(fd) == 0;
+#else
+    return ::close(fd) == 0;
+#endif
+}
+
+bool truncateFile(int fd, uint64_t size) {
+#ifdef _WIN32
+    return ::_chsize_s(fd, static_cast<__int64>(size)) == 0;
+#else
+    return ::ftruncate(fd, static_cast<off_t>(size)) == 0;
+#endif
+}
+
+// Makes a rename into path's directory durable
+void syncDirectory(const std::string& path) {
+#ifndef _WIN32
+    std::string dir = std::filesystem::path(path).parent_path().string();
+    int fd = ::open(dir.empty() ? "." : dir.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+    ::fsync(fd);
+    ::close(fd);
+#else
+    (void)path;
+#endif
+}
+
+}  // namespace
+
+MessageHandler::MessageHandler(const std::string& file, StoreMode storeMode, bool sync)
+    : filename(file), logFilename(file + ".log"), mode(storeMode), syncWrites(sync) {
     loadFromFile();
 }
 
 MessageHandler::~MessageHandler() {
-    saveToFile();
+    std::unique_lock<std::mutex> lock(mutex);
+    flushed.wait(lock, [this] { return !flushing; });
+    if (mode == StoreMode::Rewrite) {
+        saveToFile(syncWrites);
+        return;
+    }
+    bool saved = compact();
+    if (logFd >= 0) closeFile(logFd);
+    // Without a saved file the log is all that holds the latest changes
+    std::error_code ec;
+    if (saved) std::filesystem::remove(logFilename, ec);
 }
 
 void MessageHandler::addMessage(const std::string& user, const std::string& text) {
     Message msg(user, text);
     msg.generateId();
     msg.generateTimestamp();
-    std::lock_guard<std::mutex> lock(mutex);
-    messages.push_back(msg);
-    saveToFile();
+    auto lock = lockTraced();
+    mutableMessages().push_back(msg);
+    messageBytes += sizeOf(msg);
+    persist(lock, 1);
 }
 
 void MessageHandler::addMessage(const Message& msg) {
-    std::lock_guard<std::mutex> lock(mutex);
-    messages.push_back(msg);
-    saveToFile();
+    auto lock = lockTraced();
+    mutableMessages().push_back(msg);
+    messageBytes += sizeOf(msg);
+    persist(lock, 1);
+}
+
+void MessageHandler::addMessages(const std::vector<Message>& batch) {
+    if (batch.empty()) return;
+    auto lock = lockTraced();
+    auto& list = mutableMessages();
+    list.insert(list.end(), batch.begin(), batch.end());
+    for (const auto& msg : batch) messageBytes += sizeOf(msg);
+    persist(lock, batch.size());
 }
 
 std::vector<Message> MessageHandler::getAllMessages() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return *messages;
+}
+
+std::shared_ptr<const std::vector<Message>> MessageHandler::snapshot() const {
     std::lock_guard<std::mutex> lock(mutex);
     return messages;
 }
 
-void MessageHandler::clear() {
+std::shared_ptr<const std::vector<Message>> MessageHandler::snapshot(uint64_t& version) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    version = changes.load(std::memory_order_relaxed);
+    return messages;
+}
+
+MessageHandler::Stats MessageHandler::stats() const {
     std::lock_guard<std::mutex> lock(mutex);
-    messages.clear();
-    saveToFile();
+    Stats s;
+    s.messages = messages->size();
+    s.bytes = messageBytes;
+    s.written = written;
+    return s;
+}
+
+uint64_t MessageHandler::sizeOf(const Message& msg) {
+    return msg.id.size() + msg.user.size() + msg.message.size() + msg.timestamp.size();
+}
+
+std::unique_lock<std::mutex> MessageHandler::lockTraced() const {
+    Trace::Span span("lock_wait");
+    return std::unique_lock<std::mutex>(mutex);
+}
+
+std::vector<Message>& MessageHandler::mutableMessages() {
+    changes.fetch_add(1, std::memory_order_release);
+    // New snapshots are only taken under the mutex, so a count of one is exact
+    if (messages.use_count() > 1) messages = std::make_shared<std::vector<Message>>(*messages);
+    return *messages;
+}
+
+void MessageHandler::clear() {
+    auto lock = lockTraced();
+    flushed.wait(lock, [this] { return !flushing; });
+    changes.fetch_add(1, std::memory_order_release);
+    if (messages.use_count() > 1) {
+        messages = std::make_shared<std::vector<Message>>();
+    } else {
+        messages->clear();
+    }
+    messageBytes = 0;
+    if (mode == StoreMode::Rewrite) {
+        saveToFile(syncWrites);
+    } else {
+        compact();
+    }
 }
 
 void MessageHandler::loadFromFile() {
     std::lock_guard<std::mutex> lock(mutex);
     std::ifstream file(filename);
-    if (!file.is_open()) return;
-    try {
-        json j;
-        file >> j;
-        messages.clear();
-        for (const auto& item : j) {
-            Message msg;
-            msg.id = item.value("id", "");
-            msg.user = item.value("user", "");
-            msg.message = item.value("message", "");
-            msg.timestamp = item.value("timestamp", "");
-            messages.push_back(msg);
+    if (file.is_open()) {
+        try {
+            json j;
+            file >> j;
+            auto& list = mutableMessages();
+            list.clear();
+            messageBytes = 0;
+            for (const auto& item : j) {
+                Message msg;
+                msg.id = item.value("id", "");
+                msg.user = item.value("user", "");
+                msg.message = item.value("message", "");
+                msg.timestamp = item.value("timestamp", "");
+                messageBytes += sizeOf(msg);
+                list.push_back(msg);
+            }
+        } catch (const std::exception& e) {
+            LOG_ERROR("messages_load_failed", {"file", filename}, {"error", e.what()});
         }
-    } catch (const std::exception& e) {
-        std::cerr << "Error loading messages: " << e.what() << "\n";
+        file.close();
+    }
+
+    std::error_code ec;
+    // Left by a save that never got as far as the rename
+    std::filesystem::remove(filename + ".tmp", ec);
+    fileBytes = std::filesystem::file_size(filename, ec);
+    if (ec) fileBytes = 0;
+    // A log left by a run that did not shut down cleanly, in any mode, is
+    // replayed and folded into the file so the next log starts from it
+    bool hadLog = std::filesystem::exists(logFilename, ec);
+    if (hadLog) replayLog(mutableMessages());
+    if (mode != StoreMode::Rewrite) {
+        if (!hadLog) startLog();
+        else if (!compact()) reopenLog();
+    } else if (hadLog && saveToFile(true)) {
+        std::filesystem::remove(logFilename, ec);
     }
 }
 
-void MessageHandler::saveToFile() const {
-    std::lock_guard<std::mutex> lock(mutex);
-    std::ofstream file(filename);
-    if (!file.is_open()) return;
-    try {
-        json j = json::array();
-        for (const auto& m : messages) {
-            j.push_back({
-                {"id", m.id},
-                {"user", m.user},
-                {"message", m.message},
-                {"timestamp", m.timestamp}
-            });
+// The log starts with {"base":N}, the number of messages the file held when
+// the log was started. If the file holds any other number, the log was
+// folded into it before a crash could remove the log, so the log is stale.
+void MessageHandler::replayLog(std::vector<Message>& list) {
+    std::ifstream in(logFilename);
+    if (!in.is_open()) return;
+    std::string line;
+    if (!std::getline(in, line)) return;
+    json header = json::parse(line, nullptr, false);
+    if (header.is_discarded() || !header.is_object() || header.value("base", uint64_t(0)) != list.size()) {
+        LOG_WARN("messages_log_stale", {"file", logFilename});
+        return;
+    }
+    size_t replayed = 0;
+    while (std::getline(in, line)) {
+        json item = json::parse(line, nullptr, false);
+        if (item.is_discarded() || !item.is_object()) {
+            // Only the last write can be torn; everything after it is lost with it
+            LOG_WARN("messages_log_truncated", {"file", logFilename}, {"records", replayed});
+            break;
+        }
+        Message msg;
+        msg.id = item.value("id", "");
+        msg.user = item.value("user", "");
+        msg.message = item.value("message", "");
+        msg.timestamp = item.value("timestamp", "");
+        messageBytes += sizeOf(msg);
+        list.push_back(std::move(msg));
+        ++replayed;
+    }
+    LOG_INFO("messages_log_replayed", {"file", logFilename}, {"records", replayed});
+}
+
+void MessageHandler::persist(std::unique_lock<std::mutex>& lock, size_t added) {
+    if (mode == StoreMode::Rewrite) {
+        saveToFile(syncWrites);
+        return;
+    }
+    for (size_t i = messages->size() - added; i < messages->size(); ++i) {
+        appendJson(pending, (*messages)[i]);
+        pending += '\n';
+    }
+    uint64_t sequence = ++appended;
+    if (mode == StoreMode::AppendLog) {
+        if (writeLog(pending)) {
+            logBytes += pending.size();
+            written += pending.size();
+        }
+        pending.clear();
+        durable = sequence;
+    } else {
+        // Whoever finds no flush running writes everything pending, including
+        // records added by others while it was waiting for the lock
+        while (durable < sequence) {
+            if (flushing) {
+                flushed.wait(lock);
+                continue;
+            }
+            flushing = true;
+            std::string batch;
+            batch.swap(pending);
+            uint64_t upTo = appended;
+            lock.unlock();
+            bool ok = writeLog(batch);
+            lock.lock();
+            if (ok) {
+                logBytes += batch.size();
+                written += batch.size();
+            }
+            durable = std::max(durable, upTo);
+            flushing = false;
+            flushed.notify_all();
         }
-        file << j.dump(4);
+    }
+    if (logBytes >= std::max(kMinCompactBytes, fileBytes) && !flushing) compact();
+}
+
+bool MessageHandler::writeLog(const std::string& records) {
+    auto started = std::chrono::steady_clock::now();
+    bool ok = logFd >= 0 && writeAll(logFd, records) && (!syncWrites || syncFile(logFd));
+    auto done = std::chrono::steady_clock::now();
+    if (!ok) {
+        LOG_ERROR("messages_log_write_failed", {"file", logFilename}, {"error", std::strerror(errno)});
+        // Cut off a partial record, or replay would stop there and drop
+        // every record appended after it
+        if (logFd >= 0) truncateFile(logFd, logBytes);
+        return false;
+    }
+    flushTimes.record(done - started);
+    saveTimes.record(done - started);
+    Trace::record("flush", started, done);
+    Trace::record("save", started, done);
+    return true;
+}
+
+bool MessageHandler::compact() {
+    if (!saveToFile(true)) return false;
+    // Everything pending is already in the file
+    pending.clear();
+    durable = appended;
+    flushed.notify_all();
+    startLog();
+    return true;
+}
+
+void MessageHandler::startLog() {
+    if (logFd >= 0) closeFile(logFd);
+    logFd = openFile(logFilename, true);
+    std::string header = "{\"base\":" + std::to_string(messages->size()) + "}\n";
+    if (logFd < 0 || !writeAll(logFd, header) || (syncWrites && !syncFile(logFd))) {
+        LOG_ERROR("messages_log_open_failed", {"file", logFilename}, {"error", std::strerror(errno)});
+        return;
+    }
+    logBytes = header.size();
+    written += header.size();
+}
+
+void MessageHandler::reopenLog() {
+    if (logFd >= 0) closeFile(logFd);
+    logFd = openFile(logFilename, false);
+    if (logFd < 0) {
+        LOG_ERROR("messages_log_open_failed", {"file", logFilename}, {"error", std::strerror(errno)});
+        return;
+    }
+    std::error_code ec;
+    logBytes = std::filesystem::file_size(logFilename, ec);
+}
+
+bool MessageHandler::saveToFile(bool sync) {
+    auto started = std::chrono::steady_clock::now();
+    std::string temp = filename + ".tmp";
+    std::string out;
+    try {
+        JsonEncoder::appendArray(out, *messages);
     } catch (const std::exception& e) {
-        std::cerr << "Error saving messages: " << e.what() << "\n";
+        LOG_ERROR("messages_save_failed", {"file", filename}, {"error", e.what()});
+        return false;
+    }
+    int fd = openFile(temp, true);
+    if (fd < 0) {
+        LOG_ERROR("messages_save_failed", {"file", temp}, {"error", std::strerror(errno)});
+        return false;
+    }
+    bool ok = writeAll(fd, out);
+    auto flushStarted = std::chrono::steady_clock::now();
+    ok = ok && (!sync || syncFile(fd));
+    ok = closeFile(fd) && ok;
+    std::error_code ec;
+    if (ok) std::filesystem::rename(temp, filename, ec);
+    if (!ok || ec) {
+        LOG_ERROR("messages_save_failed", {"file", filename}, {"error", ec ? ec.message() : std::strerror(errno)});
+        std::filesystem::remove(temp, ec);
+        return false;
     }
+    if (sync) syncDirectory(filename);
+    auto flushed = std::chrono::steady_clock::now();
+    fileBytes = out.size();
+    written += out.size();
+    flushTimes.record(flushed - flushStarted);
+    saveTimes.record(flushed - started);
+    Trace::record("flush", flushStarted, flushed);
+    Trace::record("save", started, flushed);
+    return true;
 }
\ No newline at end of file
@@ -2,23 +2,93 @@
 
 #include <string>
 #include <vector>
+#include <memory>
+#include <atomic>
 #include <mutex>
+#include <condition_variable>
 #include "message.hpp"
+#include "../util/metrics.hpp"
+
+// How changes reach the history file. The file itself is only ever replaced
+// whole: written to <file>.tmp, then renamed over it.
+enum class StoreMode {
+    Rewrite,      // The whole history is rewritten on every change
+    AppendLog,    // Each change is appended to <file>.log; the log is folded
+                  // into the file once it outgrows it, and on shutdown
+    GroupCommit   // As AppendLog, but writers that arrive during a write share
+                  // the next write and sync
+};
 
 class MessageHandler {
     public:
-        explicit MessageHandler(const std::string& file);
+        // syncWrites: every change is fdatasynced before it returns, so an
+        // acknowledged change survives power loss and not just a crash.
+        // Folding a log into the file syncs either way, since the log is then
+        // dropped.
+        explicit MessageHandler(const std::string& file, StoreMode mode = StoreMode::Rewrite, bool syncWrites = false);
         ~MessageHandler();
         void addMessage(const std::string& user, const std::string& text);
         void addMessage(const Message& msg);
+        void addMessages(const std::vector<Message>& batch);  // One save for the whole batch
         std::vector<Message> getAllMessages() const;
+        // Immutable view of the history at this moment; later writes copy
+        // instead of modifying it, so it can be read without the lock
+        std::shared_ptr<const std::vector<Message>> snapshot() const;
+        // As snapshot(), with the version() it was taken at
+        std::shared_ptr<const std::vector<Message>> snapshot(uint64_t& version) const;
+        // Grows with every change to the history, so anything built from a
+        // snapshot can be reused until it moves on
+        uint64_t version() const { return changes.load(std::memory_order_acquire); }
         void clear();  // Added clear method declaration
 
+        struct Stats {
+            size_t messages = 0;
+            uint64_t bytes = 0;  // Text of every field, excluding JSON framing
+            uint64_t written = 0;  // Bytes written to the history file and log since startup
+        };
+        Stats stats() const;
+        const Metrics::Histogram& saveDurations() const { return saveTimes; }    // Encode, write and flush
+        const Metrics::Histogram& flushDurations() const { return flushTimes; }  // write() and sync, once per log write
+        StoreMode storeMode() const { return mode; }
+
     private:
         void loadFromFile();
-        void saveToFile() const;
+        void replayLog(std::vector<Message>& list);
+        // Caller must hold mutex; false if the file was left as it was. sync
+        // puts the new file on disk before the rename.
+        bool saveToFile(bool sync);
+        // Makes the last `added` messages durable as the mode requires; lock is
+        // held on entry and exit
+        void persist(std::unique_lock<std::mutex>& lock, size_t added);
+        bool writeLog(const std::string& records);  // One writer at a time
+        // Caller must hold mutex with no group flush running. The log is only
+        // dropped once the file replacing it is on disk.
+        bool compact();
+        void startLog();
+        void reopenLog();  // Appends to the log left on disk when compaction failed
+        std::vector<Message>& mutableMessages();  // Caller must hold mutex
+        std::unique_lock<std::mutex> lockTraced() const;  // Records the wait as a "lock_wait" span
+        static uint64_t sizeOf(const Message& msg);
 
         std::string filename;
-        std::vector<Message> messages;
+        std::string logFilename;
+        StoreMode mode;
+        bool syncWrites;
+        std::shared_ptr<std::vector<Message>> messages = std::make_shared<std::vector<Message>>();
+        uint64_t messageBytes = 0;
+        uint64_t written = 0;
+        std::atomic<uint64_t> changes{0};  // Bumped under mutex, before the change is made
         mutable std::mutex mutex;
+
+        // Log modes
+        int logFd = -1;
+        uint64_t logBytes = 0;
+        uint64_t fileBytes = 0;  // Size of the last full write
+        std::string pending;     // Group commit: records waiting for the next flush
+        uint64_t appended = 0;   // Group commit: sequence of the last record in pending
+        uint64_t durable = 0;    // Group commit: sequence of the last record flushed
+        bool flushing = false;
+        std::condition_variable flushed;
+        mutable Metrics::Histogram saveTimes;
+        mutable Metrics::Histogram flushTimes;
 };
@@ -1,13 +1,19 @@
 #include "peer_discovery.hpp"
 #include "../util/utils.hpp"
+#include <cstdio>
 #include <random>
-#include <iostream>
+#include "../util/log.hpp"
 
-PeerDiscovery::PeerDiscovery() {
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<> dis(1000, 9999);
-    peerId = "peer_" + std::to_string(dis(gen));
+PeerDiscovery::PeerDiscovery(const PeerDiscoveryConfig& cfg) : peerId(cfg.peerId), config(cfg) {
+    if (peerId.empty()) {
+        // Wide enough that a segment of thousands of peers is unlikely to
+        // see two share an ID; four digits collided from about a hundred
+        std::random_device rd;
+        std::mt19937_64 gen((uint64_t(rd()) << 32) ^ rd());
+        char buf[24];
+        std::snprintf(buf, sizeof(buf), "peer_%016llx", static_cast<unsigned long long>(gen()));
+        peerId = buf;
+    }
     SocketUtils::initialize();
 }
 
@@ -31,33 +37,72 @@ void PeerDiscovery::stop() {
 }
 
 std::vector<PeerInfo> PeerDiscovery::getActivePeers() {
+    return getActivePeers(Clock::now());
+}
+
+std::vector<PeerInfo> PeerDiscovery::getActivePeers(Clock::time_point now) {
+    uint64_t version;
+    return getActivePeers(now, version);
+}
+
+std::vector<PeerInfo> PeerDiscovery::getActivePeers(Clock::time_point now, uint64_t& version) {
     std::lock_guard<std::mutex> lock(peersMutex);
-    cleanupExpired();
+    cleanupExpired(now);
+    version = changes;
     std::vector<PeerInfo> active;
+    active.reserve(peers.size());
     for (const auto& [_, info] : peers) {
         active.push_back(info);
     }
     return active;
 }
 
+std::string PeerDiscovery::announcement() const {
+    return "DISCOVER:" + peerId + ":" + Utils::getCurrentTimeString();
+}
+
+bool PeerDiscovery::receive(std::string_view datagram, const std::string& address, Clock::time_point now) {
+    auto parts = Utils::split(std::string(datagram), ':');
+    if (parts.size() < 2 || parts[0] != "DISCOVER") return false;
+    const std::string& id = parts[1];
+    if (id == peerId) return false;
+    std::lock_guard<std::mutex> lock(peersMutex);
+    auto [it, added] = peers.try_emplace(id);
+    if (added || it->second.address != address) ++changes;
+    it->second.id = id;
+    it->second.address = address;
+    it->second.lastSeen = now;
+    return added;
+}
+
+uint64_t PeerDiscovery::version(Clock::time_point now) {
+    std::lock_guard<std::mutex> lock(peersMutex);
+    cleanupExpired(now);
+    return changes;
+}
+
+size_t PeerDiscovery::expire(Clock::time_point now) {
+    std::lock_guard<std::mutex> lock(peersMutex);
+    return cleanupExpired(now);
+}
+
 void PeerDiscovery::broadcastLoop() {
     UDPSocket sock;
     if (!sock.setBroadcast(true) || !sock.bind(0)) {
-        std::cerr << "Broadcast setup failed\n";
+        LOG_ERROR("peer_broadcast_setup_failed");
         running = false;
         return;
     }
     while (running) {
-        std::string msg = "DISCOVER:" + peerId + ":" + Utils::getCurrentTimeString();
-        sock.sendTo(msg, "255.255.255.255", port);
-        std::this_thread::sleep_for(std::chrono::seconds(5));
+        sock.sendTo(announcement(), "255.255.255.255", config.port);
+        std::this_thread::sleep_for(config.announceInterval);
     }
 }
 
 void PeerDiscovery::listenLoop() {
     UDPSocket sock;
-    if (!sock.bind(port)) {
-        std::cerr << "Listener bind failed\n";
+    if (!sock.bind(config.port)) {
+        LOG_ERROR("peer_listener_bind_failed", {"port", config.port});
         running = false;
         return;
     }
@@ -65,27 +110,21 @@ void PeerDiscovery::listenLoop() {
         std::string data, ip;
         int fromPort;
         if (sock.receiveFrom(data, ip, fromPort)) {
-            auto parts = Utils::split(data, ':');
-            if (parts.size() >= 2 && parts[0] == "DISCOVER") {
-                std::string id = parts[1];
-                if (id != peerId) {
-                    std::lock_guard<std::mutex> lock(peersMutex);
-                    peers[id].id = id;
-                    peers[id].address = ip;
-                    peers[id].lastSeen = std::chrono::steady_clock::now();
-                }
-            }
+            receive(data, ip, Clock::now());
         }
     }
 }
 
-void PeerDiscovery::cleanupExpired() {
-    auto now = std::chrono::steady_clock::now();
+size_t PeerDiscovery::cleanupExpired(Clock::time_point now) {
+    size_t dropped = 0;
     for (auto it = peers.begin(); it != peers.end(); ) {
-        if (std::chrono::duration_cast<std::chrono::seconds>(now - it->second.lastSeen).count() > 30) {
+        if (std::chrono::duration_cast<std::chrono::seconds>(now - it->second.lastSeen) > config.expiry) {
             it = peers.erase(it);
+            ++dropped;
+            ++changes;
         } else {
             ++it;
         }
     }
+    return dropped;
 }
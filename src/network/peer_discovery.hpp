@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <unordered_map>
 #include <mutex>
@@ -8,6 +9,7 @@
 #include <atomic>
 #include <chrono>
 #include "sockets.hpp"
+#include "../util/json_encoder.hpp"
 
 struct PeerInfo {
     std::string id;
@@ -15,23 +17,55 @@ struct PeerInfo {
     std::chrono::steady_clock::time_point lastSeen;
 };
 
+// lastSeen is local bookkeeping and is not sent
+template <class Out>
+void appendJson(Out& out, const PeerInfo& p) {
+    out += "{\"address\":";
+    JsonEncoder::appendString(out, p.address);
+    out += ",\"id\":";
+    JsonEncoder::appendString(out, p.id);
+    out += '}';
+}
+
+struct PeerDiscoveryConfig {
+    std::string peerId;                        // Empty = random
+    int port = 45454;
+    std::chrono::seconds announceInterval{5};
+    std::chrono::seconds expiry{30};           // Peers silent for longer are dropped
+};
+
 class PeerDiscovery {
 public:
-    PeerDiscovery();
+    using Clock = std::chrono::steady_clock;
+
+    explicit PeerDiscovery(const PeerDiscoveryConfig& config = PeerDiscoveryConfig());
     ~PeerDiscovery();
     void start();
     void stop();
     std::vector<PeerInfo> getActivePeers();
+    std::vector<PeerInfo> getActivePeers(Clock::time_point now);
+    std::vector<PeerInfo> getActivePeers(Clock::time_point now, uint64_t& version);
+    // Grows whenever a peer is added, dropped or changes address, that is
+    // whenever the /peers JSON would change
+    uint64_t version(Clock::time_point now);
+
+    // The protocol without the UDP loops, for other transports and the simulator
+    const std::string& id() const { return peerId; }
+    std::string announcement() const;  // Datagram broadcast every announceInterval
+    // Records the sender of a datagram; true if it was not known before
+    bool receive(std::string_view datagram, const std::string& address, Clock::time_point now);
+    size_t expire(Clock::time_point now);  // Peers dropped
 private:
     void broadcastLoop();
     void listenLoop();
-    void cleanupExpired();
+    size_t cleanupExpired(Clock::time_point now);  // Caller must hold peersMutex
 
     std::string peerId;
-    int port = 45454;
+    PeerDiscoveryConfig config;
     std::atomic<bool> running{false};
     std::thread broadcastTh;
     std::thread listenTh;
     std::unordered_map<std::string, PeerInfo> peers;
+    uint64_t changes = 0;  // Guarded by peersMutex
     std::mutex peersMutex;
 };
@@ -1,6 +1,11 @@
 #include "sockets.hpp"
 #include <iostream>
 #include <cstring>
+#include <algorithm>
+#include <cerrno>
+#ifndef _WIN32
+#include <poll.h>
+#endif
 
 bool SocketUtils::initialize() {
 #ifdef _WIN32
@@ -16,6 +21,48 @@ void SocketUtils::cleanup() {
 #endif
 }
 
+bool SocketUtils::setNonBlocking(SOCKET s, bool enable) {
+#ifdef _WIN32
+    u_long mode = enable ? 1 : 0;
+    return ioctlsocket(s, FIONBIO, &mode) == 0;
+#else
+    int flags = fcntl(s, F_GETFL, 0);
+    if (flags < 0) return false;
+    flags = enable ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+    return fcntl(s, F_SETFL, flags) == 0;
+#endif
+}
+
+uint32_t SocketUtils::peerAddress(SOCKET s) {
+    sockaddr_in addr{};
+    socklen_t len = sizeof(addr);
+    if (getpeername(s, (sockaddr*)&addr, &len) != 0 || addr.sin_family != AF_INET) return 0;
+    return ntohl(addr.sin_addr.s_addr);
+}
+
+bool SocketUtils::waitReadable(SOCKET s, int timeoutMs) {
+#ifdef _WIN32
+    WSAPOLLFD pfd{};
+    pfd.fd = s;
+    pfd.events = POLLRDNORM;
+    return WSAPoll(&pfd, 1, timeoutMs) > 0;
+#else
+    pollfd pfd{};
+    pfd.fd = s;
+    pfd.events = POLLIN;
+    return ::poll(&pfd, 1, timeoutMs) > 0;
+#endif
+}
+
+bool SocketUtils::setSendTimeout(SOCKET s, int timeoutMs) {
+#ifdef _WIN32
+    DWORD tv = timeoutMs;
+#else
+    timeval tv = {timeoutMs / 1000, (timeoutMs % 1000) * 1000};
+#endif
+    return setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, (const char*)&tv, sizeof(tv)) == 0;
+}
+
 UDPSocket::UDPSocket() {
     sock = socket(AF_INET, SOCK_DGRAM, 0);
 }
@@ -41,11 +88,7 @@ bool UDPSocket::sendTo(const std::string& data, const std::string& ip, int port)
 }
 
 bool UDPSocket::receiveFrom(std::string& data, std::string& ip, int& port, int timeoutMs) {
-    fd_set fds;
-    FD_ZERO(&fds);
-    FD_SET(sock, &fds);
-    timeval tv = {timeoutMs / 1000, (timeoutMs % 1000) * 1000};
-    if (select(sock + 1, &fds, nullptr, nullptr, &tv) > 0) {
+    if (SocketUtils::waitReadable(sock, timeoutMs)) {
         char buf[4096];
         sockaddr_in sender;
         socklen_t len = sizeof(sender);
@@ -81,13 +124,22 @@ TCPServer::~TCPServer() {
     close();
 }
 
-bool TCPServer::listen(int port, int backlog) {
+bool TCPServer::listen(int port, int backlog, bool reusePort) {
     sockaddr_in addr{};
     addr.sin_family = AF_INET;
     addr.sin_port = htons(port);
     addr.sin_addr.s_addr = INADDR_ANY;
     int opt = 1;
     setsockopt(listenSock, SOL_SOCKET, SO_REUSEADDR, (char*)&opt, sizeof(opt));
+#ifdef SO_REUSEPORT
+    // Lets several sockets bind the same port; the kernel load-balances
+    // incoming connections across them
+    if (reusePort && setsockopt(listenSock, SOL_SOCKET, SO_REUSEPORT, (char*)&opt, sizeof(opt)) != 0) {
+        return false;
+    }
+#else
+    if (reusePort) return false;
+#endif
     if (::bind(listenSock, (sockaddr*)&addr, sizeof(addr)) == 0 && ::listen(listenSock, backlog) == 0) {
         return true;
     }
@@ -101,6 +153,12 @@ SOCKET TCPServer::acceptClient(sockaddr_in& clientAddr) {
 
 void TCPServer::close() {
     if (listenSock != INVALID_SOCKET) {
+        // shutdown() wakes a thread blocked in accept(); close() alone does not on Linux
+#ifdef _WIN32
+        shutdown(listenSock, SD_BOTH);
+#else
+        shutdown(listenSock, SHUT_RDWR);
+#endif
         CLOSE_SOCKET(listenSock);
         listenSock = INVALID_SOCKET;
     }
@@ -114,12 +172,29 @@ TCPSocket::~TCPSocket() {
 }
 
 bool TCPSocket::send(const std::string& data) {
-    return ::send(sock, data.c_str(), data.size(), 0) != SOCKET_ERROR;
+#ifdef MSG_NOSIGNAL
+    const int flags = MSG_NOSIGNAL;  // A vanished peer must not kill the process with SIGPIPE
+#else
+    const int flags = 0;
+#endif
+    // send() may accept only part of the buffer; keep going until all of it is out
+    size_t offset = 0;
+    while (offset < data.size()) {
+        int sent = ::send(sock, data.c_str() + offset, static_cast<int>(data.size() - offset), flags);
+        if (sent == SOCKET_ERROR) {
+#ifndef _WIN32
+            if (errno == EINTR) continue;
+#endif
+            return false;
+        }
+        offset += sent;
+    }
+    return true;
 }
 
 bool TCPSocket::receive(std::string& data, size_t maxLen) {
     char buf[4096];
-    int bytes = ::recv(sock, buf, maxLen, 0);
+    int bytes = ::recv(sock, buf, std::min(maxLen, sizeof(buf)), 0);
     if (bytes > 0) {
         data = std::string(buf, bytes);
         return true;
@@ -127,6 +202,14 @@ bool TCPSocket::receive(std::string& data, size_t maxLen) {
     return false;
 }
 
+int TCPSocket::receive(char* buf, size_t len) {
+    return ::recv(sock, buf, static_cast<int>(len), 0);
+}
+
+bool TCPSocket::waitReadable(int timeoutMs) {
+    return SocketUtils::waitReadable(sock, timeoutMs);
+}
+
 void TCPSocket::close() {
     if (sock != INVALID_SOCKET) {
         CLOSE_SOCKET(sock);
@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdint>
 #include <string>
 
 #ifdef _WIN32
@@ -11,7 +12,7 @@
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <fcntl.h>
-#define CLOSE_SOCKET close
+#define CLOSE_SOCKET ::close
 #define INVALID_SOCKET -1
 #define SOCKET_ERROR -1
 typedef int SOCKET;
@@ -21,6 +22,11 @@ class SocketUtils {
 public:
     static bool initialize();
     static void cleanup();
+    static bool setNonBlocking(SOCKET s, bool enable);
+    static uint32_t peerAddress(SOCKET s);  // IPv4 address in host order, 0 if unknown
+    static bool setSendTimeout(SOCKET s, int timeoutMs);  // Blocking sends fail after this long without progress
+    // poll() rather than select(), which cannot watch descriptors past FD_SETSIZE
+    static bool waitReadable(SOCKET s, int timeoutMs);
 };
 
 class UDPSocket {
@@ -40,8 +46,9 @@ class TCPServer {
 public:
     TCPServer();
     ~TCPServer();
-    bool listen(int port, int backlog = 5);
+    bool listen(int port, int backlog = SOMAXCONN, bool reusePort = false);
     SOCKET acceptClient(sockaddr_in& clientAddr);
+    SOCKET nativeHandle() const { return listenSock; }
     void close();
 private:
     SOCKET listenSock = INVALID_SOCKET;
@@ -53,7 +60,10 @@ public:
     ~TCPSocket();
     bool send(const std::string& data);
     bool receive(std::string& data, size_t maxLen = 4096);
+    int receive(char* buf, size_t len);  // Bytes read, 0 on close, -1 on error
+    bool waitReadable(int timeoutMs);
     void close();
+    SOCKET nativeHandle() const { return sock; }
 private:
     SOCKET sock;
 };
\ No newline at end of file
@@ -0,0 +1,121 @@
+#include "buffer_pool.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+namespace {
+
+size_t classSize(size_t cls) {
+    return BufferPool::kMinClassSize << (2 * cls);
+}
+
+// Index of the smallest class that fits, or kClassCount if none does
+size_t classFor(size_t size) {
+    for (size_t cls = 0; cls < BufferPool::kClassCount; ++cls) {
+        if (size <= classSize(cls)) return cls;
+    }
+    return BufferPool::kClassCount;
+}
+
+struct ThreadCache {
+    char* free[BufferPool::kClassCount][BufferPool::kMaxCachedPerClass];
+    size_t count[BufferPool::kClassCount] = {};
+
+    ~ThreadCache() {
+        for (size_t cls = 0; cls < BufferPool::kClassCount; ++cls) {
+            for (size_t i = 0; i < count[cls]; ++i) std::free(free[cls][i]);
+        }
+    }
+};
+
+ThreadCache& cache() {
+    thread_local ThreadCache c;
+    return c;
+}
+
+}  // namespace
+
+BufferPool::Buffer::Buffer(Buffer&& other) noexcept : ptr(other.ptr), cap(other.cap) {
+    other.ptr = nullptr;
+    other.cap = 0;
+}
+
+BufferPool::Buffer& BufferPool::Buffer::operator=(Buffer&& other) noexcept {
+    if (this != &other) {
+        reset();
+        ptr = other.ptr;
+        cap = other.cap;
+        other.ptr = nullptr;
+        other.cap = 0;
+    }
+    return *this;
+}
+
+void BufferPool::Buffer::reset() {
+    if (ptr) BufferPool::release(ptr, cap);
+    ptr = nullptr;
+    cap = 0;
+}
+
+BufferPool::Buffer BufferPool::acquire(size_t minSize) {
+    Buffer b;
+    size_t cls = classFor(minSize);
+    if (cls < kClassCount) {
+        ThreadCache& c = cache();
+        b.cap = classSize(cls);
+        b.ptr = c.count[cls] > 0 ? c.free[cls][--c.count[cls]] : static_cast<char*>(std::malloc(b.cap));
+    } else {
+        b.cap = minSize;
+        b.ptr = static_cast<char*>(std::malloc(b.cap));
+    }
+    if (!b.ptr) throw std::bad_alloc();
+    return b;
+}
+
+void BufferPool::release(char* ptr, size_t cap) {
+    size_t cls = classFor(cap);
+    if (cls < kClassCount && classSize(cls) == cap) {
+        ThreadCache& c = cache();
+        if (c.count[cls] < kMaxCachedPerClass) {
+            c.free[cls][c.count[cls]++] = ptr;
+            return;
+        }
+    }
+    std::free(ptr);
+}
+
+char* RecvBuffer::prepare(size_t minFree, size_t& avail) {
+    if (buf.capacity() - end < minFree) {
+        size_t used = end - start;
+        if (buf && buf.capacity() - used >= minFree) {
+            std::memmove(buf.data(), buf.data() + start, used);
+        } else {
+            // Grow into the next class that fits, doubling so appends stay amortized O(1)
+            BufferPool::Buffer bigger = BufferPool::acquire(std::max(used + minFree, buf.capacity() * 2));
+            if (used) std::memcpy(bigger.data(), buf.data() + start, used);
+            buf = std::move(bigger);
+        }
+        start = 0;
+        end = used;
+    }
+    avail = buf.capacity() - end;
+    return buf.data() + end;
+}
+
+void RecvBuffer::append(const char* data, size_t len) {
+    size_t avail;
+    std::memcpy(prepare(len, avail), data, len);
+    commit(len);
+}
+
+void RecvBuffer::consume(size_t bytes) {
+    start += bytes;
+    if (start >= end) clear();
+}
+
+void RecvBuffer::clear() {
+    buf.reset();
+    start = 0;
+    end = 0;
+}
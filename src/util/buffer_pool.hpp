@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+// Recycled byte buffers in a few size classes (4K, 16K, 64K, 256K). Each
+// thread keeps a small free list per class, so steady-state connection I/O
+// reuses memory instead of going to the global heap. Larger requests are
+// allocated exactly and freed on release.
+class BufferPool {
+public:
+    static const size_t kClassCount = 4;
+    static const size_t kMinClassSize = 4096;
+    static const size_t kMaxCachedPerClass = 32;  // Per thread
+
+    // Owning handle; returns its memory to the pool when destroyed or reset
+    class Buffer {
+    public:
+        Buffer() = default;
+        Buffer(Buffer&& other) noexcept;
+        Buffer& operator=(Buffer&& other) noexcept;
+        Buffer(const Buffer&) = delete;
+        Buffer& operator=(const Buffer&) = delete;
+        ~Buffer() { reset(); }
+
+        char* data() const { return ptr; }
+        size_t capacity() const { return cap; }
+        explicit operator bool() const { return ptr != nullptr; }
+        void reset();
+    private:
+        friend class BufferPool;
+        char* ptr = nullptr;
+        size_t cap = 0;
+    };
+
+    // Smallest pooled buffer holding at least minSize bytes
+    static Buffer acquire(size_t minSize);
+private:
+    static void release(char* ptr, size_t cap);
+};
+
+// Receive-side byte queue backed by pooled buffers: data is read straight
+// into prepare()'d space, consumed from the front, and the buffer goes back
+// to the pool as soon as it is empty, so idle connections hold no memory.
+class RecvBuffer {
+public:
+    std::string_view view() const { return std::string_view(buf.data() + start, end - start); }
+    size_t size() const { return end - start; }
+    bool empty() const { return start == end; }
+
+    // Returns writable space of at least minFree bytes (reported in avail),
+    // compacting or moving to a larger size class as needed
+    char* prepare(size_t minFree, size_t& avail);
+    void commit(size_t bytes) { end += bytes; }
+    void append(const char* data, size_t len);
+    void consume(size_t bytes);
+    void clear();
+private:
+    BufferPool::Buffer buf;
+    size_t start = 0;
+    size_t end = 0;
+};
@@ -0,0 +1,135 @@
+#include "json_encoder.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define JSON_ENCODER_X86 1
+#include <emmintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+#include <immintrin.h>
+#define JSON_ENCODER_AVX2 1
+#endif
+#endif
+
+namespace JsonEncoder {
+
+namespace {
+
+inline bool needsEscape(unsigned char c) {
+    return c < 0x20 || c == '"' || c == '\\';
+}
+
+size_t scalarFindEscape(const char* data, size_t len) {
+    for (size_t i = 0; i < len; ++i) {
+        if (needsEscape(static_cast<unsigned char>(data[i]))) return i;
+    }
+    return len;
+}
+
+#ifdef JSON_ENCODER_X86
+
+inline unsigned ctz(unsigned mask) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long idx;
+    _BitScanForward(&idx, mask);
+    return idx;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+// A byte is a control character when min(byte, 0x1f) == byte, unsigned
+size_t sse2FindEscape(const char* data, size_t len) {
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1f);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+                                   _mm_cmpeq_epi8(_mm_min_epu8(chunk, control), chunk));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(hit));
+        if (mask) return i + ctz(mask);
+    }
+    return i + scalarFindEscape(data + i, len - i);
+}
+
+#ifdef JSON_ENCODER_AVX2
+
+__attribute__((target("avx2")))
+size_t avx2FindEscape(const char* data, size_t len) {
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i control = _mm256_set1_epi8(0x1f);
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        __m256i hit = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(chunk, quote), _mm256_cmpeq_epi8(chunk, backslash)),
+            _mm256_cmpeq_epi8(_mm256_min_epu8(chunk, control), chunk));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(hit));
+        if (mask) return i + ctz(mask);
+    }
+    // Strings are mostly short: finish byte by byte rather than switching widths
+    return i + scalarFindEscape(data + i, len - i);
+}
+
+#endif  // JSON_ENCODER_AVX2
+#endif  // JSON_ENCODER_X86
+
+struct Kernel {
+    const char* name;
+    size_t (*findEscape)(const char*, size_t);
+};
+
+Kernel simdKernel() {
+#ifdef JSON_ENCODER_X86
+#ifdef JSON_ENCODER_AVX2
+    if (__builtin_cpu_supports("avx2")) return {"avx2", avx2FindEscape};
+#endif
+    return {"sse2", sse2FindEscape};
+#else
+    return {"scalar", scalarFindEscape};
+#endif
+}
+
+Kernel& kernel() {
+    static Kernel k = simdKernel();
+    return k;
+}
+
+}  // namespace
+
+size_t findEscape(const char* data, size_t len) {
+    // Ids, names and timestamps are shorter than a vector; skip the dispatch
+    if (len < 16) return scalarFindEscape(data, len);
+    return kernel().findEscape(data, len);
+}
+
+size_t escape(unsigned char c, char* buf) {
+    buf[0] = '\\';
+    switch (c) {
+    case '"': buf[1] = '"'; return 2;
+    case '\\': buf[1] = '\\'; return 2;
+    case '\b': buf[1] = 'b'; return 2;
+    case '\f': buf[1] = 'f'; return 2;
+    case '\n': buf[1] = 'n'; return 2;
+    case '\r': buf[1] = 'r'; return 2;
+    case '\t': buf[1] = 't'; return 2;
+    default:
+        buf[1] = 'u';
+        buf[2] = '0';
+        buf[3] = '0';
+        buf[4] = "0123456789abcdef"[c >> 4];
+        buf[5] = "0123456789abcdef"[c & 0xf];
+        return 6;
+    }
+}
+
+void forceScalar(bool scalar) {
+    kernel() = scalar ? Kernel{"scalar", scalarFindEscape} : simdKernel();
+}
+
+const char* kernelName() {
+    return kernel().name;
+}
+
+}  // namespace JsonEncoder
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+// Compact JSON written straight into a string, for the types the server
+// sends and stores. Out is std::string or std::pmr::string; types provide an
+// appendJson(Out&, const T&) overload next to their definition.
+namespace JsonEncoder {
+
+// Offset of the first byte that must be escaped in a JSON string ('"', '\\'
+// or a control character), or len if there is none. Uses SSE2/AVX2 on x86.
+size_t findEscape(const char* data, size_t len);
+// Writes the escape sequence for c into buf (at least 6 bytes); returns its length
+size_t escape(unsigned char c, char* buf);
+
+// Uses the scalar kernel even where SIMD is available; for benchmarks
+void forceScalar(bool scalar);
+const char* kernelName();
+
+// Appends s as a quoted string, escaping the same characters as
+// nlohmann::json::dump(). s must already be valid UTF-8.
+template <class Out>
+void appendString(Out& out, std::string_view s) {
+    out += '"';
+    while (!s.empty()) {
+        size_t n = findEscape(s.data(), s.size());
+        out.append(s.data(), n);
+        if (n == s.size()) break;
+        char buf[6];
+        out.append(buf, escape(static_cast<unsigned char>(s[n]), buf));
+        s.remove_prefix(n + 1);
+    }
+    out += '"';
+}
+
+template <class Out, class T>
+void appendArray(Out& out, const std::vector<T>& items) {
+    out += '[';
+    for (size_t i = 0; i < items.size(); ++i) {
+        if (i > 0) out += ',';
+        appendJson(out, items[i]);
+    }
+    out += ']';
+}
+
+}  // namespace JsonEncoder
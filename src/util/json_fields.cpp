@@ -0,0 +1,317 @@
+#include "json_fields.hpp"
+#include <cstring>
+
+namespace {
+
+bool hex4(const char* p, unsigned& value) {
+    value = 0;
+    for (int i = 0; i < 4; ++i) {
+        char c = p[i];
+        value <<= 4;
+        if (c >= '0' && c <= '9') value |= c - '0';
+        else if (c >= 'a' && c <= 'f') value |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') value |= c - 'A' + 10;
+        else return false;
+    }
+    return true;
+}
+
+void appendUtf8(std::string& out, unsigned cp) {
+    if (cp < 0x80) {
+        out += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        out += static_cast<char>(0xC0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        out += static_cast<char>(0xE0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (cp >> 18));
+        out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+}
+
+}  // namespace
+
+JsonFields::JsonFields(std::initializer_list<std::string_view> keys) {
+    for (auto key : keys) {
+        if (fieldCount == kMaxFields) break;
+        fields[fieldCount++].key = key;
+    }
+}
+
+bool JsonFields::parse(std::string_view text) {
+    for (size_t i = 0; i < fieldCount; ++i) fields[i].kind = Field::Kind::Missing;
+    scratch.clear();
+    pos = text.data();
+    end = pos + text.size();
+    if (text.substr(0, 3) == "\xEF\xBB\xBF") pos += 3;  // json::parse skips a BOM too
+    skipWhitespace();
+    object = pos < end && *pos == '{';
+    bool ok = parseValue(0, nullptr);
+    skipWhitespace();
+    ok = ok && pos == end;
+    if (!ok) object = false;
+    return ok;
+}
+
+bool JsonFields::get(std::string_view key, std::string_view& value) const {
+    if (!object) return false;
+    for (size_t i = 0; i < fieldCount; ++i) {
+        const Field& f = fields[i];
+        if (f.key != key) continue;
+        if (f.kind == Field::Kind::Other) return false;
+        if (f.kind == Field::Kind::String) {
+            value = f.decoded ? std::string_view(scratch.data() + f.offset, f.length) : f.raw;
+        }
+        return true;
+    }
+    return true;
+}
+
+void JsonFields::skipWhitespace() {
+    while (pos < end && (*pos == ' ' || *pos == '\t' || *pos == '\n' || *pos == '\r')) ++pos;
+}
+
+bool JsonFields::parseValue(size_t depth, Field* target) {
+    if (pos == end) return false;
+    if (target && *pos != '"') target->kind = Field::Kind::Other;
+    switch (*pos) {
+    case '{': return parseObject(depth + 1);
+    case '[': return parseArray(depth + 1);
+    case '"': return parseString(target);
+    case 't': return parseLiteral("true");
+    case 'f': return parseLiteral("false");
+    case 'n': return parseLiteral("null");
+    default: return parseNumber();
+    }
+}
+
+bool JsonFields::parseObject(size_t depth) {
+    if (depth > kMaxDepth) return false;
+    ++pos;
+    skipWhitespace();
+    if (pos < end && *pos == '}') {
+        ++pos;
+        return true;
+    }
+    while (true) {
+        if (pos == end || *pos != '"') return false;
+        Field* target = nullptr;
+        if (depth == 1) {  // The top-level object
+            // Keys may be escaped too; a decoded key is only needed for the lookup
+            size_t mark = scratch.size();
+            std::string_view key;
+            if (!parseString(nullptr, &key)) return false;
+            for (size_t i = 0; i < fieldCount && !target; ++i) {
+                if (fields[i].key == key) target = &fields[i];
+            }
+            scratch.resize(mark);
+        } else if (!parseString(nullptr)) {
+            return false;
+        }
+        skipWhitespace();
+        if (pos == end || *pos != ':') return false;
+        ++pos;
+        skipWhitespace();
+        if (target) target->kind = Field::Kind::Missing;  // Last duplicate wins, as in json::parse
+        if (!parseValue(depth, target)) return false;
+        skipWhitespace();
+        if (pos == end) return false;
+        if (*pos == '}') {
+            ++pos;
+            return true;
+        }
+        if (*pos != ',') return false;
+        ++pos;
+        skipWhitespace();
+    }
+}
+
+bool JsonFields::parseArray(size_t depth) {
+    if (depth > kMaxDepth) return false;
+    ++pos;
+    skipWhitespace();
+    if (pos < end && *pos == ']') {
+        ++pos;
+        return true;
+    }
+    while (true) {
+        if (!parseValue(depth, nullptr)) return false;
+        skipWhitespace();
+        if (pos == end) return false;
+        if (*pos == ']') {
+            ++pos;
+            return true;
+        }
+        if (*pos != ',') return false;
+        ++pos;
+        skipWhitespace();
+    }
+}
+
+bool JsonFields::parseString(Field* target, std::string_view* out) {
+    const char* start = ++pos;
+    bool escaped = false;
+    while (true) {
+        if (pos == end) return false;
+        unsigned char c = static_cast<unsigned char>(*pos);
+        if (c == '"') break;
+        if (c == '\\') {
+            if (!scanEscape()) return false;
+            escaped = true;
+        } else if (c < 0x20) {
+            return false;
+        } else if (c >= 0x80) {
+            if (!scanUtf8()) return false;
+        } else {
+            ++pos;
+        }
+    }
+    const char* stop = pos++;
+    if (!target && !out) return true;
+
+    std::string_view value(start, stop - start);
+    size_t offset = scratch.size();
+    if (escaped) {
+        decode(start, stop);
+        value = std::string_view(scratch.data() + offset, scratch.size() - offset);
+    }
+    if (out) *out = value;
+    if (target) {
+        target->kind = Field::Kind::String;
+        target->decoded = escaped;
+        target->raw = escaped ? std::string_view() : value;
+        target->offset = offset;
+        target->length = value.size();
+    }
+    return true;
+}
+
+bool JsonFields::scanEscape() {
+    if (end - pos < 2) return false;
+    switch (pos[1]) {
+    case '"': case '\\': case '/': case 'b': case 'f': case 'n': case 'r': case 't':
+        pos += 2;
+        return true;
+    case 'u':
+        break;
+    default:
+        return false;
+    }
+    unsigned cp;
+    if (end - pos < 6 || !hex4(pos + 2, cp)) return false;
+    pos += 6;
+    if (cp >= 0xDC00 && cp <= 0xDFFF) return false;  // Low surrogate on its own
+    if (cp < 0xD800 || cp > 0xDBFF) return true;
+    // A high surrogate must be followed by an escaped low one
+    unsigned low;
+    if (end - pos < 6 || pos[0] != '\\' || pos[1] != 'u' || !hex4(pos + 2, low)) return false;
+    if (low < 0xDC00 || low > 0xDFFF) return false;
+    pos += 6;
+    return true;
+}
+
+// Well-formed UTF-8 per RFC 3629: no overlong forms, surrogates or code
+// points past U+10FFFF
+bool JsonFields::scanUtf8() {
+    auto in = [this](size_t i, unsigned lo, unsigned hi) {
+        if (end - pos <= static_cast<std::ptrdiff_t>(i)) return false;
+        unsigned c = static_cast<unsigned char>(pos[i]);
+        return c >= lo && c <= hi;
+    };
+    unsigned c = static_cast<unsigned char>(*pos);
+    size_t n;
+    bool ok;
+    if (c >= 0xC2 && c <= 0xDF) {
+        n = 2;
+        ok = in(1, 0x80, 0xBF);
+    } else if (c == 0xE0) {
+        n = 3;
+        ok = in(1, 0xA0, 0xBF) && in(2, 0x80, 0xBF);
+    } else if (c == 0xED) {
+        n = 3;
+        ok = in(1, 0x80, 0x9F) && in(2, 0x80, 0xBF);
+    } else if (c >= 0xE1 && c <= 0xEF) {
+        n = 3;
+        ok = in(1, 0x80, 0xBF) && in(2, 0x80, 0xBF);
+    } else if (c == 0xF0) {
+        n = 4;
+        ok = in(1, 0x90, 0xBF) && in(2, 0x80, 0xBF) && in(3, 0x80, 0xBF);
+    } else if (c >= 0xF1 && c <= 0xF3) {
+        n = 4;
+        ok = in(1, 0x80, 0xBF) && in(2, 0x80, 0xBF) && in(3, 0x80, 0xBF);
+    } else if (c == 0xF4) {
+        n = 4;
+        ok = in(1, 0x80, 0x8F) && in(2, 0x80, 0xBF) && in(3, 0x80, 0xBF);
+    } else {
+        return false;
+    }
+    if (ok) pos += n;
+    return ok;
+}
+
+bool JsonFields::parseNumber() {
+    auto digit = [this] { return pos < end && *pos >= '0' && *pos <= '9'; };
+    if (pos < end && *pos == '-') ++pos;
+    if (pos < end && *pos == '0') {
+        ++pos;
+    } else if (digit()) {
+        while (digit()) ++pos;
+    } else {
+        return false;
+    }
+    if (pos < end && *pos == '.') {
+        ++pos;
+        if (!digit()) return false;
+        while (digit()) ++pos;
+    }
+    if (pos < end && (*pos == 'e' || *pos == 'E')) {
+        ++pos;
+        if (pos < end && (*pos == '+' || *pos == '-')) ++pos;
+        if (!digit()) return false;
+        while (digit()) ++pos;
+    }
+    return true;
+}
+
+bool JsonFields::parseLiteral(std::string_view word) {
+    if (static_cast<size_t>(end - pos) < word.size() || std::string_view(pos, word.size()) != word) return false;
+    pos += word.size();
+    return true;
+}
+
+// Input was validated by parseString, so every escape here is well formed
+void JsonFields::decode(const char* from, const char* to) {
+    while (from < to) {
+        const char* esc = static_cast<const char*>(std::memchr(from, '\\', to - from));
+        if (!esc) esc = to;
+        scratch.append(from, esc - from);
+        if (esc == to) break;
+        char c = esc[1];
+        from = esc + 2;
+        switch (c) {
+        case 'b': scratch += '\b'; break;
+        case 'f': scratch += '\f'; break;
+        case 'n': scratch += '\n'; break;
+        case 'r': scratch += '\r'; break;
+        case 't': scratch += '\t'; break;
+        case 'u': {
+            unsigned cp, low;
+            hex4(from, cp);
+            from += 4;
+            if (cp >= 0xD800 && cp <= 0xDBFF) {
+                hex4(from + 2, low);
+                cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                from += 6;
+            }
+            appendUtf8(scratch, cp);
+            break;
+        }
+        default: scratch += c; break;  // '"', '\\' or '/'
+        }
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+
+// On-demand reader for small JSON request bodies. parse() validates the
+// whole document as json::parse would, but only keeps the string values of
+// a few top-level keys instead of building a tree. Values without escapes
+// are views into the parsed text; escaped ones are decoded into a scratch
+// buffer owned by the reader.
+class JsonFields {
+public:
+    static const size_t kMaxFields = 4;
+    static const size_t kMaxDepth = 512;  // Deeper nesting is rejected
+
+    // Keys must outlive the reader; any past kMaxFields are ignored
+    JsonFields(std::initializer_list<std::string_view> keys);
+
+    // False if text is not exactly one valid JSON value. The text must
+    // outlive the views handed out by get()
+    bool parse(std::string_view text);
+
+    // Like json::value(key, default): a missing key leaves value untouched.
+    // False if the document is not an object or the key holds a non-string.
+    bool get(std::string_view key, std::string_view& value) const;
+
+private:
+    struct Field {
+        enum class Kind { Missing, String, Other };
+        std::string_view key;
+        Kind kind = Kind::Missing;
+        std::string_view raw;  // Contents as written, when there were no escapes
+        size_t offset = 0;     // Decoded contents in scratch otherwise
+        size_t length = 0;
+        bool decoded = false;
+    };
+
+    bool parseValue(size_t depth, Field* target);
+    bool parseObject(size_t depth);
+    bool parseArray(size_t depth);
+    bool parseString(Field* target, std::string_view* out = nullptr);
+    bool parseNumber();
+    bool parseLiteral(std::string_view word);
+    bool scanEscape();
+    bool scanUtf8();
+    void decode(const char* from, const char* to);
+    void skipWhitespace();
+
+    std::array<Field, kMaxFields> fields;
+    size_t fieldCount = 0;
+    bool object = false;
+    std::string scratch;
+    const char* pos = nullptr;
+    const char* end = nullptr;
+};
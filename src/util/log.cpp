@@ -0,0 +1,342 @@
+#include "log.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Log {
+
+namespace {
+
+const size_t kSlots = 1024;       // Records per thread ring
+const size_t kRecordBytes = 240;  // Formatted text per record; longer text is truncated
+const size_t kBatchBytes = 64 * 1024;  // Written out once a batch reaches this
+
+std::atomic<Level> runtimeLevel{Level::Debug};
+
+struct Record {
+    int64_t timeNs;  // system_clock, since the epoch
+    Level level;
+    uint16_t length;
+    char text[kRecordBytes];
+};
+
+// Written only by its thread and read only by the writer
+struct Ring {
+    std::array<Record, kSlots> records;
+    std::atomic<uint64_t> head{0};  // Next record the thread fills
+    std::atomic<uint64_t> tail{0};  // Next record the writer reads
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<bool> closed{false};  // Thread has exited; remove once drained
+    unsigned thread = 0;
+};
+
+// Formats into a record's fixed buffer, marking truncation with "..."
+class Formatter {
+public:
+    Formatter(char* buf, size_t cap) : buf(buf), cap(cap) {}
+
+    void put(char c) {
+        if (len < cap) buf[len++] = c;
+        else truncated = true;
+    }
+    void append(std::string_view s) {
+        size_t n = std::min(s.size(), cap - len);
+        std::copy(s.data(), s.data() + n, buf + len);
+        len += n;
+        if (n < s.size()) truncated = true;
+    }
+    template <class T>
+    void number(T value) {
+        char tmp[24];
+        auto res = std::to_chars(tmp, tmp + sizeof(tmp), value);
+        append(std::string_view(tmp, res.ptr - tmp));
+    }
+    // logfmt: bare unless the value is empty or has spaces, quotes, '=' or controls
+    void value(std::string_view s) {
+        bool quote = s.empty();
+        for (char c : s) {
+            if (c == ' ' || c == '"' || c == '=' || c == '\\' || static_cast<unsigned char>(c) < 0x20) {
+                quote = true;
+                break;
+            }
+        }
+        if (!quote) {
+            append(s);
+            return;
+        }
+        put('"');
+        for (char c : s) {
+            if (c == '"' || c == '\\') {
+                put('\\');
+                put(c);
+            } else if (c == '\n') {
+                append("\\n");
+            } else if (c == '\r') {
+                append("\\r");
+            } else if (c == '\t') {
+                append("\\t");
+            } else {
+                put(static_cast<unsigned char>(c) < 0x20 ? '?' : c);
+            }
+        }
+        put('"');
+    }
+    size_t finish() {
+        if (truncated && cap >= 3) {
+            std::copy_n("...", 3, buf + cap - 3);
+            len = cap;
+        }
+        return len;
+    }
+
+private:
+    char* buf;
+    size_t cap;
+    size_t len = 0;
+    bool truncated = false;
+};
+
+const char* levelName(Level level) {
+    switch (level) {
+    case Level::Debug: return "DEBUG";
+    case Level::Info: return "INFO";
+    case Level::Warn: return "WARN";
+    default: return "ERROR";
+    }
+}
+
+class Writer {
+public:
+    Writer() : thread([this] { run(); }) {}
+
+    ~Writer() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        cv.notify_all();
+        thread.join();
+    }
+
+    std::shared_ptr<Ring> attach() {
+        auto ring = std::make_shared<Ring>();
+        std::lock_guard<std::mutex> lock(mutex);
+        ring->thread = ++threadCount;
+        rings.push_back(ring);
+        return ring;
+    }
+
+    void wake() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            wakeRequested = true;
+        }
+        cv.notify_all();
+    }
+
+    void flush() {
+        std::unique_lock<std::mutex> lock(mutex);
+        // The pass in progress may have missed the caller's records; wait for the next one
+        uint64_t target = passes + 2;
+        wakeRequested = true;
+        cv.notify_all();
+        cv.wait(lock, [&] { return passes >= target || stopping; });
+    }
+
+    void setOutput(FILE* info, FILE* error) {
+        std::lock_guard<std::mutex> lock(mutex);
+        infoOut = info;
+        errorOut = error;
+    }
+
+    std::atomic<uint64_t> droppedTotal{0};
+
+private:
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        // Sized once so a steady log stream never reallocates
+        infoBatch.reserve(kBatchBytes + 512);
+        errorBatch.reserve(kBatchBytes + 512);
+        while (true) {
+            drain();
+            ++passes;
+            cv.notify_all();
+            if (stopping) break;
+            cv.wait_for(lock, std::chrono::milliseconds(20), [this] { return wakeRequested || stopping; });
+            wakeRequested = false;
+        }
+    }
+
+    // Caller holds mutex
+    void drain() {
+        for (auto it = rings.begin(); it != rings.end();) {
+            Ring& ring = **it;
+            bool closed = ring.closed.load(std::memory_order_acquire);  // Before head: no record is missed
+            uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+            uint64_t head = ring.head.load(std::memory_order_acquire);
+            for (; tail < head; ++tail) format(ring, ring.records[tail % kSlots]);
+            ring.tail.store(tail, std::memory_order_release);
+            if (uint64_t lost = ring.dropped.exchange(0, std::memory_order_relaxed)) {
+                droppedTotal.fetch_add(lost, std::memory_order_relaxed);
+                Record note;
+                note.timeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::system_clock::now().time_since_epoch()).count();
+                note.level = Level::Warn;
+                Formatter f(note.text, kRecordBytes);
+                f.append("log_dropped count=");
+                f.number(lost);
+                note.length = static_cast<uint16_t>(f.finish());
+                format(ring, note);
+            }
+            it = closed ? rings.erase(it) : it + 1;
+        }
+        write(infoBatch, infoOut);
+        write(errorBatch, errorOut);
+    }
+
+    void format(const Ring& ring, const Record& r) {
+        std::string& out = r.level >= Level::Warn ? errorBatch : infoBatch;
+        time_t second = static_cast<time_t>(r.timeNs / 1000000000);
+        if (second != cachedSecond) {
+            std::tm tm{};
+#ifdef _WIN32
+            localtime_s(&tm, &second);
+#else
+            localtime_r(&second, &tm);
+#endif
+            std::strftime(cachedPrefix, sizeof(cachedPrefix), "%Y-%m-%d %H:%M:%S", &tm);
+            cachedSecond = second;
+        }
+        int ms = static_cast<int>(r.timeNs / 1000000 % 1000);
+        out += cachedPrefix;
+        out += '.';
+        out += static_cast<char>('0' + ms / 100);
+        out += static_cast<char>('0' + ms / 10 % 10);
+        out += static_cast<char>('0' + ms % 10);
+        out += ' ';
+        out += levelName(r.level);
+        out += ' ';
+        out.append(r.text, r.length);
+        out += " thread=";
+        out += std::to_string(ring.thread);
+        out += '\n';
+        if (out.size() >= kBatchBytes) write(out, &out == &infoBatch ? infoOut : errorOut);
+    }
+
+    static void write(std::string& batch, FILE* out) {
+        if (!batch.empty() && out) {
+            std::fwrite(batch.data(), 1, batch.size(), out);
+            std::fflush(out);
+        }
+        batch.clear();
+    }
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::vector<std::shared_ptr<Ring>> rings;
+    unsigned threadCount = 0;
+    bool stopping = false;
+    bool wakeRequested = false;
+    uint64_t passes = 0;
+    FILE* infoOut = stdout;
+    FILE* errorOut = stderr;
+    std::string infoBatch;
+    std::string errorBatch;
+    time_t cachedSecond = -1;
+    char cachedPrefix[32] = {};
+    std::thread thread;  // Last: starts once everything above is initialized
+};
+
+Writer& writer() {
+    static Writer w;
+    return w;
+}
+
+// Marks the ring closed when its thread exits; the writer frees it once drained
+struct ThreadRing {
+    std::shared_ptr<Ring> ring;
+    ~ThreadRing() {
+        if (ring) ring->closed.store(true, std::memory_order_release);
+    }
+};
+
+thread_local ThreadRing localRing;
+
+Ring& threadRing() {
+    if (!localRing.ring) localRing.ring = writer().attach();
+    return *localRing.ring;
+}
+
+}  // namespace
+
+bool enabled(Level level) {
+    return compiledIn(level) && level >= runtimeLevel.load(std::memory_order_relaxed);
+}
+
+void setLevel(Level level) {
+    runtimeLevel.store(level, std::memory_order_relaxed);
+}
+
+bool parseLevel(std::string_view name, Level& level) {
+    if (name == "debug") level = Level::Debug;
+    else if (name == "info") level = Level::Info;
+    else if (name == "warn") level = Level::Warn;
+    else if (name == "error") level = Level::Error;
+    else if (name == "off") level = Level::Off;
+    else return false;
+    return true;
+}
+
+void setOutput(FILE* info, FILE* error) {
+    writer().setOutput(info, error);
+}
+
+void flush() {
+    writer().flush();
+}
+
+uint64_t dropped() {
+    return writer().droppedTotal.load(std::memory_order_relaxed);
+}
+
+void emit(Level level, std::string_view event, const Field* fields, size_t count) {
+    Ring& ring = threadRing();
+    uint64_t head = ring.head.load(std::memory_order_relaxed);
+    if (head - ring.tail.load(std::memory_order_acquire) >= kSlots) {
+        ring.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    Record& r = ring.records[head % kSlots];
+    r.timeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    r.level = level;
+    Formatter f(r.text, kRecordBytes);
+    f.append(event);
+    for (size_t i = 0; i < count; ++i) {
+        const Field& field = fields[i];
+        f.put(' ');
+        f.append(field.key);
+        f.put('=');
+        switch (field.type) {
+        case Field::Type::Str: f.value(field.str); break;
+        case Field::Type::Int: f.number(field.i); break;
+        case Field::Type::Uint: f.number(field.u); break;
+        }
+    }
+    r.length = static_cast<uint16_t>(f.finish());
+    ring.head.store(head + 1, std::memory_order_release);
+    // Warnings are rare and worth seeing promptly; a half-full ring means the
+    // periodic drain is falling behind this thread
+    if (level >= Level::Warn || head - ring.tail.load(std::memory_order_relaxed) == kSlots / 2) writer().wake();
+}
+
+}  // namespace Log
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string_view>
+#include <type_traits>
+
+// Structured logging off the request path. Each thread formats records into
+// its own fixed-size ring; a background thread drains the rings and writes
+// batches to stdout (Debug/Info) and stderr (Warn/Error). A full ring drops
+// the record and counts it rather than block the caller.
+//
+//   LOG_DEBUG("request", {"rid", id}, {"path", req.path});
+//
+// prints "2026-10-18 09:30:00.123 DEBUG request rid=42 path=/messages".
+// Levels below LANCHAT_LOG_MIN_LEVEL are compiled out entirely, and the
+// arguments of disabled levels are never evaluated.
+namespace Log {
+
+enum class Level : uint8_t { Debug, Info, Warn, Error, Off };
+
+#ifndef LANCHAT_LOG_MIN_LEVEL
+#define LANCHAT_LOG_MIN_LEVEL 0
+#endif
+constexpr Level kCompiledLevel = static_cast<Level>(LANCHAT_LOG_MIN_LEVEL);
+
+constexpr bool compiledIn(Level level) { return level >= kCompiledLevel; }
+
+// One key=value pair. String values are copied when the record is formatted,
+// so views into request buffers are fine.
+struct Field {
+    enum class Type : uint8_t { Str, Int, Uint };
+
+    Field(const char* key, std::string_view value) : key(key), type(Type::Str), str(value) {}
+    Field(const char* key, const char* value) : key(key), type(Type::Str), str(value) {}
+    template <class T, std::enable_if_t<std::is_integral_v<T> && std::is_signed_v<T>, int> = 0>
+    Field(const char* key, T value) : key(key), type(Type::Int), i(value) {}
+    template <class T, std::enable_if_t<std::is_integral_v<T> && std::is_unsigned_v<T>, int> = 0>
+    Field(const char* key, T value) : key(key), type(Type::Uint), u(value) {}
+
+    const char* key;
+    Type type;
+    std::string_view str;
+    long long i = 0;
+    unsigned long long u = 0;
+};
+
+bool enabled(Level level);
+void setLevel(Level level);
+bool parseLevel(std::string_view name, Level& level);
+
+// Where the writer sends records; nullptr discards that half
+void setOutput(FILE* info, FILE* error);
+// Waits until everything logged before the call has been written
+void flush();
+// Records dropped because a thread's ring was full, since startup
+uint64_t dropped();
+
+void emit(Level level, std::string_view event, const Field* fields, size_t count);
+
+inline void write(Level level, std::string_view event) { emit(level, event, nullptr, 0); }
+inline void write(Level level, std::string_view event, const Field& a) { emit(level, event, &a, 1); }
+inline void write(Level level, std::string_view event, const Field& a, const Field& b) {
+    const Field f[] = {a, b};
+    emit(level, event, f, 2);
+}
+inline void write(Level level, std::string_view event, const Field& a, const Field& b, const Field& c) {
+    const Field f[] = {a, b, c};
+    emit(level, event, f, 3);
+}
+inline void write(Level level, std::string_view event, const Field& a, const Field& b, const Field& c,
+                  const Field& d) {
+    const Field f[] = {a, b, c, d};
+    emit(level, event, f, 4);
+}
+inline void write(Level level, std::string_view event, const Field& a, const Field& b, const Field& c,
+                  const Field& d, const Field& e) {
+    const Field f[] = {a, b, c, d, e};
+    emit(level, event, f, 5);
+}
+inline void write(Level level, std::string_view event, const Field& a, const Field& b, const Field& c,
+                  const Field& d, const Field& e, const Field& g) {
+    const Field f[] = {a, b, c, d, e, g};
+    emit(level, event, f, 6);
+}
+
+}  // namespace Log
+
+#define LOG_AT(level, ...)                                                   \
+    do {                                                                     \
+        if constexpr (Log::compiledIn(level)) {                              \
+            if (Log::enabled(level)) Log::write(level, __VA_ARGS__);         \
+        }                                                                    \
+    } while (0)
+
+#define LOG_DEBUG(...) LOG_AT(Log::Level::Debug, __VA_ARGS__)
+#define LOG_INFO(...) LOG_AT(Log::Level::Info, __VA_ARGS__)
+#define LOG_WARN(...) LOG_AT(Log::Level::Warn, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_AT(Log::Level::Error, __VA_ARGS__)
@@ -0,0 +1,151 @@
+#include "metrics.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <utility>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace Metrics {
+
+namespace {
+
+inline unsigned highestBit(uint64_t v) {
+#ifdef _MSC_VER
+    unsigned long idx;
+    _BitScanReverse64(&idx, v);
+    return idx;
+#else
+    return 63 - __builtin_clzll(v);
+#endif
+}
+
+const std::pair<double, const char*> kQuantiles[] = {{0.5, "0.5"}, {0.9, "0.9"}, {0.99, "0.99"}, {0.999, "0.999"}};
+
+const unsigned kFirstExportBit = 7;   // 128 ns
+const unsigned kLastExportBit = 35;   // 34.4 s
+
+void appendSeconds(std::string& out, uint64_t ns, const char* format) {
+    char buf[32];
+    int n = std::snprintf(buf, sizeof(buf), format, static_cast<double>(ns) / 1e9);
+    out.append(buf, n);
+}
+
+void appendSeries(std::string& out, std::string_view name, std::string_view suffix, std::string_view labels) {
+    out += name;
+    out += suffix;
+    if (!labels.empty()) {
+        out += '{';
+        out += labels;
+        out += '}';
+    }
+    out += ' ';
+}
+
+}  // namespace
+
+size_t Histogram::bucketOf(uint64_t ns) {
+    if (ns < kSubBuckets) return static_cast<size_t>(ns);
+    unsigned bit = highestBit(ns);
+    if (bit > kMaxBit) return kBuckets - 1;
+    return (bit - kSubBits + 1) * kSubBuckets + ((ns >> (bit - kSubBits)) & (kSubBuckets - 1));
+}
+
+uint64_t Histogram::upperBound(size_t bucket) {
+    if (bucket < kSubBuckets) return bucket;
+    unsigned bit = static_cast<unsigned>(bucket / kSubBuckets) + kSubBits - 1;
+    uint64_t sub = bucket % kSubBuckets;
+    return ((kSubBuckets + sub + 1) << (bit - kSubBits)) - 1;
+}
+
+Histogram::Snapshot Histogram::snapshot() const {
+    Snapshot s;
+    for (const Shard& shard : shards) {
+        for (size_t i = 0; i < kBuckets; ++i) s.counts[i] += shard.counts[i].load(std::memory_order_relaxed);
+        s.sum += shard.sum.load(std::memory_order_relaxed);
+    }
+    for (uint64_t c : s.counts) s.count += c;
+    return s;
+}
+
+uint64_t Histogram::Snapshot::quantile(double q) const {
+    if (count == 0) return 0;
+    uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(q * static_cast<double>(count))));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBuckets; ++i) {
+        seen += counts[i];
+        if (seen >= rank) return upperBound(i);
+    }
+    return upperBound(kBuckets - 1);
+}
+
+uint64_t Histogram::Snapshot::countBelow(uint64_t limit) const {
+    uint64_t total = 0;
+    for (size_t i = 0; i < kBuckets && upperBound(i) < limit; ++i) total += counts[i];
+    return total;
+}
+
+void writeHeader(std::string& out, std::string_view name, std::string_view type, std::string_view help) {
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+void writeSample(std::string& out, std::string_view name, std::string_view labels, uint64_t value) {
+    appendSeries(out, name, "", labels);
+    out += std::to_string(value);
+    out += '\n';
+}
+
+void writeSeconds(std::string& out, std::string_view name, std::string_view labels, uint64_t ns) {
+    appendSeries(out, name, "", labels);
+    appendSeconds(out, ns, "%.9g");
+    out += '\n';
+}
+
+void writeHistogram(std::string& out, std::string_view name, std::string_view labels, const Histogram::Snapshot& s) {
+    auto bucketLine = [&](auto&& writeBound, uint64_t count) {
+        out += name;
+        out += "_bucket{";
+        out += labels;
+        if (!labels.empty()) out += ',';
+        out += "le=\"";
+        writeBound();
+        out += "\"} ";
+        out += std::to_string(count);
+        out += '\n';
+    };
+    for (unsigned bit = kFirstExportBit; bit <= kLastExportBit; ++bit) {
+        uint64_t limit = uint64_t(1) << bit;
+        bucketLine([&] { appendSeconds(out, limit, "%.6g"); }, s.countBelow(limit));
+    }
+    bucketLine([&] { out += "+Inf"; }, s.count);
+    appendSeries(out, name, "_sum", labels);
+    appendSeconds(out, s.sum, "%.9g");
+    out += '\n';
+    appendSeries(out, name, "_count", labels);
+    out += std::to_string(s.count);
+    out += '\n';
+}
+
+void writeQuantiles(std::string& out, std::string_view name, std::string_view labels, const Histogram::Snapshot& s) {
+    std::string series(labels);
+    if (!series.empty()) series += ',';
+    size_t base = series.size();
+    for (const auto& [q, text] : kQuantiles) {
+        series.resize(base);
+        series += "quantile=\"";
+        series += text;
+        series += '"';
+        writeSeconds(out, name, series, s.quantile(q));
+    }
+}
+
+}  // namespace Metrics
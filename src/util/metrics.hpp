@@ -0,0 +1,101 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Counters and latency histograms cheap enough to record on every request.
+// Each thread records into its own cache-line aligned shard with relaxed
+// atomics, so recording threads never contend; reading sums the shards and
+// is meant for the occasional scrape.
+namespace Metrics {
+
+const size_t kShards = 16;  // Threads beyond this share shards
+
+inline size_t shardIndex() {
+    static std::atomic<size_t> next{0};
+    thread_local size_t index = next.fetch_add(1, std::memory_order_relaxed) % kShards;
+    return index;
+}
+
+// N independent counters, e.g. one per route and status code
+template <size_t N>
+class CounterSet {
+public:
+    void add(size_t i, uint64_t n = 1) { shards[shardIndex()].values[i].fetch_add(n, std::memory_order_relaxed); }
+
+    uint64_t value(size_t i) const {
+        uint64_t total = 0;
+        for (const auto& shard : shards) total += shard.values[i].load(std::memory_order_relaxed);
+        return total;
+    }
+
+private:
+    struct alignas(64) Shard {
+        std::array<std::atomic<uint64_t>, N> values{};
+    };
+    std::array<Shard, kShards> shards;
+};
+
+using Counter = CounterSet<1>;
+
+// Log-linear buckets in the style of HdrHistogram: eight per power of two, so
+// a recorded value is known to within 12.5%, from 1 ns up to about 36 minutes.
+// Larger values land in the last bucket.
+class Histogram {
+public:
+    static const unsigned kSubBits = 3;
+    static const size_t kSubBuckets = size_t(1) << kSubBits;
+    static const unsigned kMaxBit = 40;
+    static const size_t kBuckets = (kMaxBit - kSubBits + 2) * kSubBuckets;
+
+    struct Snapshot {
+        std::array<uint64_t, kBuckets> counts{};
+        uint64_t count = 0;
+        uint64_t sum = 0;  // Nanoseconds
+
+        // Upper bound of the bucket holding the q-th quantile; 0 when empty
+        uint64_t quantile(double q) const;
+        // Values recorded below limit nanoseconds; exact when limit is a power of two
+        uint64_t countBelow(uint64_t limit) const;
+    };
+
+    void record(uint64_t ns) {
+        Shard& shard = shards[shardIndex()];
+        shard.counts[bucketOf(ns)].fetch_add(1, std::memory_order_relaxed);
+        shard.sum.fetch_add(ns, std::memory_order_relaxed);
+    }
+    void record(std::chrono::steady_clock::duration elapsed) {
+        record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+    }
+    void recordSince(std::chrono::steady_clock::time_point start) { record(std::chrono::steady_clock::now() - start); }
+
+    Snapshot snapshot() const;
+
+    static size_t bucketOf(uint64_t ns);
+    static uint64_t upperBound(size_t bucket);  // Largest value the bucket holds
+
+private:
+    struct alignas(64) Shard {
+        std::array<std::atomic<uint64_t>, kBuckets> counts{};
+        std::atomic<uint64_t> sum{0};
+    };
+    std::array<Shard, kShards> shards;
+};
+
+// Prometheus text exposition format, version 0.0.4. Labels are passed
+// preformatted, e.g. R"(phase="parse")".
+void writeHeader(std::string& out, std::string_view name, std::string_view type, std::string_view help);
+void writeSample(std::string& out, std::string_view name, std::string_view labels, uint64_t value);
+void writeSeconds(std::string& out, std::string_view name, std::string_view labels, uint64_t ns);
+// Cumulative buckets at every power of two from 128 ns to 34 s, plus the
+// _sum and _count series, all in seconds
+void writeHistogram(std::string& out, std::string_view name, std::string_view labels, const Histogram::Snapshot& s);
+// Gauges for the 0.5, 0.9, 0.99 and 0.999 quantiles at full bucket resolution
+void writeQuantiles(std::string& out, std::string_view name, std::string_view labels, const Histogram::Snapshot& s);
+
+}  // namespace Metrics
@@ -0,0 +1,64 @@
+#include "rate_limiter.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+uint64_t mix(uint64_t x) {
+    // splitmix64 finalizer
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+}  // namespace
+
+RateLimiter::RateLimiter(size_t slots) {
+    size_t perShard = kProbe;
+    while (perShard * kShards < slots) perShard *= 2;
+    mask = perShard - 1;
+    for (Shard& shard : shards) shard.slots.resize(perShard);
+}
+
+uint32_t RateLimiter::acquire(uint32_t client, uint16_t cls, const Limit& limit, Clock::time_point at) {
+    if (!limit.enabled()) return 0;
+    const int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(at - epoch).count();
+    const int64_t interval = static_cast<int64_t>(1e9 / limit.perSecond);
+    const int64_t tolerance = static_cast<int64_t>((std::max(limit.burst, 1.0) - 1) * interval);
+    const uint64_t key = (uint64_t(client) << 32) | (uint64_t(cls) << 16) | 1;
+    const uint64_t hash = mix(key);
+
+    Shard& shard = shards[hash % kShards];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    Slot* slot = nullptr;
+    Slot* reusable = nullptr;
+    Slot* fullest = nullptr;
+    for (size_t i = 0; i < kProbe; ++i) {
+        Slot& s = shard.slots[(hash / kShards + i) & mask];
+        if (s.key == key) {
+            slot = &s;
+            break;
+        }
+        if (!reusable && (s.key == 0 || s.tat <= now)) reusable = &s;
+        if (!fullest || s.tat < fullest->tat) fullest = &s;
+    }
+    if (!slot) {
+        slot = reusable;
+        if (!slot) {
+            slot = fullest;
+            evicted.fetch_add(1, std::memory_order_relaxed);
+        }
+        slot->key = key;
+        slot->tat = now;
+    }
+
+    int64_t tat = std::max(slot->tat, now);
+    if (tat - now > tolerance) {
+        double wait = static_cast<double>(tat - tolerance - now) / 1e9;
+        return static_cast<uint32_t>(std::max(1.0, std::ceil(wait)));
+    }
+    slot->tat = tat + interval;
+    return 0;
+}
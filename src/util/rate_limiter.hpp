@@ -0,0 +1,56 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Token buckets per client address and class (say, one per route), held in a
+// fixed-size table. Each bucket is a single "theoretical arrival time" (the
+// GCRA form of a token bucket): a bucket whose time has passed is full, so
+// it is indistinguishable from a new one and its slot is simply reused.
+// A key may live in any of a few neighbouring slots; when all of them are
+// busy, the one closest to full is evicted, which at worst forgives that
+// client a little debt. Lookups lock one of several shards.
+class RateLimiter {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Limit {
+        double perSecond = 0;  // Sustained rate; 0 = unlimited
+        double burst = 1;      // Back-to-back requests allowed after idling
+        bool enabled() const { return perSecond > 0; }
+    };
+
+    static const size_t kShards = 16;
+    static const size_t kProbe = 8;  // Slots a key may occupy
+
+    explicit RateLimiter(size_t slots = 16384);
+
+    // 0 if the request may go ahead (and is charged), else whole seconds
+    // until it would be allowed, at least 1
+    uint32_t acquire(uint32_t client, uint16_t cls, const Limit& limit) {
+        return acquire(client, cls, limit, Clock::now());
+    }
+    uint32_t acquire(uint32_t client, uint16_t cls, const Limit& limit, Clock::time_point now);
+
+    uint64_t evictions() const { return evicted.load(std::memory_order_relaxed); }
+
+private:
+    struct Slot {
+        uint64_t key = 0;  // 0 = never used
+        int64_t tat = 0;   // Nanoseconds since epoch; the bucket is full once this has passed
+    };
+    struct alignas(64) Shard {
+        std::mutex mutex;
+        std::vector<Slot> slots;
+    };
+
+    Clock::time_point epoch = Clock::now();
+    std::array<Shard, kShards> shards;
+    size_t mask;  // Slots per shard, minus one
+    std::atomic<uint64_t> evicted{0};
+};
@@ -0,0 +1,30 @@
+#include "request_arena.hpp"
+
+namespace {
+thread_local std::pmr::memory_resource* currentArena = nullptr;
+}
+
+std::pmr::memory_resource* RequestArena::resource() {
+    if (!mono) {
+        block = BufferPool::acquire(kBlockSize);
+        mono.emplace(block.data(), block.capacity(), std::pmr::new_delete_resource());
+    }
+    return &*mono;
+}
+
+void RequestArena::reset() {
+    mono.reset();  // Frees any overflow chunks
+    block.reset();
+}
+
+std::pmr::memory_resource* RequestArena::current() {
+    return currentArena ? currentArena : std::pmr::get_default_resource();
+}
+
+RequestArena::Scope::Scope(RequestArena& arena) : previous(currentArena) {
+    currentArena = arena.resource();
+}
+
+RequestArena::Scope::~Scope() {
+    currentArena = previous;
+}
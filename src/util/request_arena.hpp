@@ -0,0 +1,39 @@
+#pragma once
+
+#include <memory_resource>
+#include <optional>
+#include "buffer_pool.hpp"
+
+// Monotonic allocation arena for the responses of one connection. Memory
+// comes from a pooled block (overflowing to the heap) and is only reclaimed
+// all at once by reset(), which the owner calls when nothing allocated from
+// the arena is still referenced.
+class RequestArena {
+public:
+    static const size_t kBlockSize = 16 * 1024;
+
+    RequestArena() = default;
+    RequestArena(const RequestArena&) = delete;
+    RequestArena& operator=(const RequestArena&) = delete;
+
+    std::pmr::memory_resource* resource();
+    void reset();
+
+    // Arena of the request being handled on this thread, or the default
+    // resource outside a Scope
+    static std::pmr::memory_resource* current();
+
+    // Makes an arena current on this thread for the lifetime of the scope
+    class Scope {
+    public:
+        explicit Scope(RequestArena& arena);
+        ~Scope();
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    private:
+        std::pmr::memory_resource* previous;
+    };
+private:
+    BufferPool::Buffer block;
+    std::optional<std::pmr::monotonic_buffer_resource> mono;
+};
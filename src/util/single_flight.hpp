@@ -0,0 +1,79 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+// Shares one immutable value, such as a serialized response body, among
+// concurrent callers. Each value is tagged with the version of the data it
+// was built from. A caller that needs at least version v gets the latest
+// value if it is that new. Otherwise, if another caller is already building,
+// it waits for that result. If nobody is building, it builds the value itself.
+// So each version is built at most once however many callers ask for it.
+// Versions must only grow.
+template <class T>
+class SingleFlight {
+public:
+    using Value = std::shared_ptr<const T>;
+    struct Versioned {
+        uint64_t version = 0;
+        Value value;  // Null: not shareable at this version; each caller builds its own
+    };
+    struct Stats {
+        uint64_t builds = 0;
+        uint64_t shared = 0;  // Served from a value already built
+        uint64_t waited = 0;  // Of those, how many waited for it to be built
+    };
+
+    // build() returns a Versioned and runs without the lock held. It is called
+    // at most once per get(); if it throws, a waiting caller takes over.
+    template <class Build>
+    Value get(uint64_t wanted, Build&& build) {
+        std::unique_lock<std::mutex> lock(mutex);
+        bool waiting = false;
+        while (true) {
+            if (hasLatest && latest.version >= wanted) {
+                ++stat.shared;
+                if (waiting) ++stat.waited;
+                return latest.value;
+            }
+            if (!building) break;
+            waiting = true;
+            done.wait(lock);
+        }
+        building = true;
+        lock.unlock();
+        Versioned result;
+        try {
+            result = build();
+        } catch (...) {
+            lock.lock();
+            building = false;
+            done.notify_all();
+            throw;
+        }
+        lock.lock();
+        building = false;
+        ++stat.builds;
+        if (!hasLatest || result.version >= latest.version) {
+            latest = result;
+            hasLatest = true;
+        }
+        done.notify_all();
+        return result.value;
+    }
+
+    Stats stats() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return stat;
+    }
+
+private:
+    mutable std::mutex mutex;
+    std::condition_variable done;
+    Versioned latest;
+    bool hasLatest = false;
+    bool building = false;
+    Stats stat;
+};
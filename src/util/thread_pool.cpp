@@ -0,0 +1,81 @@
+#include "thread_pool.hpp"
+#include "log.hpp"
+
+ThreadPool::ThreadPool(size_t threads, size_t maxQueue) : maxQueueDepth(maxQueue) {
+    if (threads == 0) threads = 1;
+    workers.reserve(threads);
+    for (size_t i = 0; i < threads; ++i) {
+        workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    shutdown();
+}
+
+bool ThreadPool::submit(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        if (stopping || queue.size() >= maxQueueDepth) {
+            rejected++;
+            return false;
+        }
+        queue.push_back({std::move(task), std::chrono::steady_clock::now()});
+    }
+    submitted++;
+    queueCv.notify_one();
+    return true;
+}
+
+void ThreadPool::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        if (stopping) return;
+        stopping = true;
+    }
+    queueCv.notify_all();
+    for (auto& t : workers) {
+        if (t.joinable()) t.join();
+    }
+}
+
+ThreadPool::Stats ThreadPool::stats() const {
+    Stats s;
+    s.submitted = submitted;
+    s.rejected = rejected;
+    s.completed = completed;
+    s.totalWaitUs = totalWaitUs;
+    s.maxWaitUs = maxWaitUs;
+    s.workers = workers.size();
+    std::lock_guard<std::mutex> lock(queueMutex);
+    s.queueDepth = queue.size();
+    return s;
+}
+
+void ThreadPool::workerLoop() {
+    while (true) {
+        Task task;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            queueCv.wait(lock, [this] { return stopping || !queue.empty(); });
+            // Drain whatever was accepted before shutdown so no socket is leaked
+            if (queue.empty()) return;
+            task = std::move(queue.front());
+            queue.pop_front();
+        }
+
+        auto waited = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - task.enqueued).count();
+        totalWaitUs += waited;
+        uint64_t prevMax = maxWaitUs;
+        while (static_cast<uint64_t>(waited) > prevMax &&
+               !maxWaitUs.compare_exchange_weak(prevMax, waited)) {}
+
+        try {
+            task.fn();
+        } catch (const std::exception& e) {
+            LOG_ERROR("worker_task_exception", {"error", e.what()});
+        }
+        completed++;
+    }
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Fixed-size worker pool fed by a bounded FIFO queue. submit() never blocks:
+// when the queue is full the task is rejected and the caller decides what to
+// do with the work (HttpServer closes the connection).
+class ThreadPool {
+public:
+    struct Stats {
+        uint64_t submitted = 0;
+        uint64_t rejected = 0;
+        uint64_t completed = 0;
+        uint64_t totalWaitUs = 0;   // Sum of time tasks spent queued
+        uint64_t maxWaitUs = 0;
+        size_t queueDepth = 0;
+        size_t workers = 0;
+    };
+
+    ThreadPool(size_t threads, size_t maxQueueDepth);
+    ~ThreadPool();
+    bool submit(std::function<void()> task);
+    void shutdown();
+    Stats stats() const;
+private:
+    struct Task {
+        std::function<void()> fn;
+        std::chrono::steady_clock::time_point enqueued;
+    };
+
+    void workerLoop();
+
+    size_t maxQueueDepth;
+    std::vector<std::thread> workers;
+    std::deque<Task> queue;
+    mutable std::mutex queueMutex;
+    std::condition_variable queueCv;
+    bool stopping = false;
+
+    std::atomic<uint64_t> submitted{0};
+    std::atomic<uint64_t> rejected{0};
+    std::atomic<uint64_t> completed{0};
+    std::atomic<uint64_t> totalWaitUs{0};
+    std::atomic<uint64_t> maxWaitUs{0};
+};
@@ -0,0 +1,81 @@
+#include "timer_wheel.hpp"
+#include <algorithm>
+
+void TimerWheel::Timer::unlink() {
+    if (!prev) return;
+    prev->next = next;
+    next->prev = prev;
+    prev = next = nullptr;
+    --wheel->armedCount;
+}
+
+TimerWheel::TimerWheel(std::chrono::milliseconds tick, Clock::time_point now)
+    : tickLength(std::max(tick, std::chrono::milliseconds(1))), epoch(now) {
+    for (auto& level : slots) {
+        for (Timer& sentinel : level) sentinel.prev = sentinel.next = &sentinel;
+    }
+}
+
+TimerWheel::~TimerWheel() {
+    // Owners may outlive the wheel; leave their timers disarmed
+    for (auto& level : slots) {
+        for (Timer& sentinel : level) {
+            while (sentinel.next != &sentinel) sentinel.next->unlink();
+            sentinel.prev = sentinel.next = nullptr;
+        }
+    }
+}
+
+uint64_t TimerWheel::ticksAt(Clock::time_point t) const {
+    if (t <= epoch) return 0;
+    return static_cast<uint64_t>((t - epoch) / tickLength);
+}
+
+void TimerWheel::schedule(Timer& timer, Clock::time_point deadline) {
+    if (timer.armed() && timer.due == deadline) return;
+    timer.unlink();
+    // Round up, so a timer never fires early
+    uint64_t ticks = ticksAt(deadline);
+    if (epoch + ticks * tickLength < deadline) ++ticks;
+    const uint64_t horizon = (uint64_t(1) << (kSlotBits * kLevels)) - 1;
+    timer.expires = std::min(std::max(ticks, current + 1), current + horizon);
+    timer.due = deadline;
+    timer.wheel = this;
+    place(timer);
+    ++armedCount;
+}
+
+void TimerWheel::place(Timer& timer) {
+    const uint64_t delta = timer.expires - current;
+    size_t level = 0;
+    while (level + 1 < kLevels && delta >= (uint64_t(1) << (kSlotBits * (level + 1)))) ++level;
+    Timer& sentinel = slots[level][(timer.expires >> (kSlotBits * level)) & (kSlots - 1)];
+    timer.prev = sentinel.prev;
+    timer.next = &sentinel;
+    sentinel.prev->next = &timer;
+    sentinel.prev = &timer;
+}
+
+void TimerWheel::cascade() {
+    // When a level's index wraps to zero, the next slot up is due to be
+    // spread over the levels below it
+    for (size_t level = 1; level < kLevels; ++level) {
+        if ((current >> (kSlotBits * (level - 1))) & (kSlots - 1)) return;
+        Timer& sentinel = slots[level][(current >> (kSlotBits * level)) & (kSlots - 1)];
+        Timer* timer = sentinel.next;
+        sentinel.prev = sentinel.next = &sentinel;
+        while (timer != &sentinel) {
+            Timer* next = timer->next;
+            place(*timer);
+            timer = next;
+        }
+    }
+}
+
+int TimerWheel::waitMs(Clock::time_point now) const {
+    if (armedCount == 0) return -1;
+    Clock::time_point nextTick = epoch + (current + 1) * tickLength;
+    if (nextTick <= now) return 0;
+    auto wait = std::chrono::ceil<std::chrono::milliseconds>(nextTick - now).count();
+    return static_cast<int>(wait);
+}
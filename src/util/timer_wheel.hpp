@@ -0,0 +1,93 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// Hierarchical timer wheel for one thread's deadlines. Four levels of 64
+// slots each: level 0 holds timers due within 64 ticks, and each higher level
+// covers 64 times the span of the one below it, cascading its timers down as
+// their turn comes. Timers are intrusive list nodes owned by the caller, so
+// arming, re-arming and cancelling are O(1) and never allocate; advancing
+// costs one slot per elapsed tick plus the timers that fire or cascade.
+// Deadlines are rounded up to the tick and capped at 64^4 ticks ahead.
+class TimerWheel {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Timer {
+        Timer() = default;
+        Timer(const Timer&) = delete;
+        Timer& operator=(const Timer&) = delete;
+        ~Timer() { unlink(); }
+
+        bool armed() const { return prev != nullptr; }
+        Clock::time_point deadline() const { return due; }
+        uint64_t data = 0;  // For the owner, e.g. a file descriptor
+
+    private:
+        friend class TimerWheel;
+        void unlink();
+
+        Timer* prev = nullptr;
+        Timer* next = nullptr;
+        uint64_t expires = 0;  // In ticks
+        Clock::time_point due;
+        TimerWheel* wheel = nullptr;
+    };
+
+    static const size_t kLevels = 4;
+    static const size_t kSlotBits = 6;
+    static const size_t kSlots = size_t(1) << kSlotBits;
+
+    explicit TimerWheel(std::chrono::milliseconds tick = std::chrono::milliseconds(100), Clock::time_point now = Clock::now());
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+    ~TimerWheel();
+
+    // (Re)arms timer to fire at the first tick at or after deadline. Re-arming
+    // with an unchanged deadline is a no-op.
+    void schedule(Timer& timer, Clock::time_point deadline);
+    void cancel(Timer& timer) { timer.unlink(); }
+
+    // Fires every timer due by now, in tick order. Each is disarmed before
+    // onExpire(Timer&) runs, which may schedule or cancel any timer.
+    template <typename Fn>
+    void advance(Clock::time_point now, Fn&& onExpire) {
+        const uint64_t target = ticksAt(now);
+        if (armedCount == 0) {
+            current = std::max(current, target);
+            return;
+        }
+        while (current < target) {
+            ++current;
+            cascade();
+            Timer& slot = slots[0][current & (kSlots - 1)];
+            while (slot.next != &slot) {
+                Timer* timer = slot.next;
+                timer->unlink();
+                onExpire(*timer);
+            }
+            if (armedCount == 0) current = target;
+        }
+    }
+
+    // Milliseconds until the next tick for epoll_wait and friends, or -1 when
+    // nothing is armed
+    int waitMs(Clock::time_point now) const;
+    size_t size() const { return armedCount; }
+    std::chrono::milliseconds tick() const { return tickLength; }
+
+private:
+    uint64_t ticksAt(Clock::time_point t) const;
+    void place(Timer& timer);
+    void cascade();
+
+    const std::chrono::milliseconds tickLength;
+    const Clock::time_point epoch;
+    uint64_t current = 0;  // Last tick processed
+    size_t armedCount = 0;
+    // Each slot is the sentinel of a circular list
+    std::array<std::array<Timer, kSlots>, kLevels> slots;
+};
@@ -0,0 +1,155 @@
+#include "trace.hpp"
+#include <array>
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+
+namespace Trace {
+
+namespace {
+
+const size_t kSlots = 4096;  // Spans kept per thread
+
+const Clock::time_point kEpoch = Clock::now();
+
+std::atomic<bool> tracing{true};
+
+// Seqlock per slot: odd while the owning thread rewrites it. Fields are
+// relaxed atomics so a racing reader sees a torn slot, never undefined behaviour.
+struct Slot {
+    std::atomic<uint64_t> seq{0};
+    std::atomic<const char*> name{nullptr};
+    std::atomic<uint64_t> requestId{0};
+    std::atomic<int64_t> startNs{0};
+    std::atomic<int64_t> durationNs{0};
+};
+
+struct Ring {
+    std::array<Slot, kSlots> slots;
+    uint64_t head = 0;  // Owner only
+    std::atomic<bool> closed{false};
+    unsigned thread = 0;
+};
+
+class Registry {
+public:
+    std::shared_ptr<Ring> attach() {
+        auto ring = std::make_shared<Ring>();
+        std::lock_guard<std::mutex> lock(mutex);
+        // Exited threads' spans are kept until another thread takes their place
+        for (auto it = rings.begin(); it != rings.end();) {
+            it = (*it)->closed.load(std::memory_order_relaxed) ? rings.erase(it) : it + 1;
+        }
+        ring->thread = ++threadCount;
+        rings.push_back(ring);
+        return ring;
+    }
+
+    std::vector<std::shared_ptr<Ring>> all() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return rings;
+    }
+
+private:
+    std::mutex mutex;
+    std::vector<std::shared_ptr<Ring>> rings;
+    unsigned threadCount = 0;
+};
+
+Registry& registry() {
+    static Registry r;
+    return r;
+}
+
+struct ThreadRing {
+    std::shared_ptr<Ring> ring;
+    ~ThreadRing() {
+        if (ring) ring->closed.store(true, std::memory_order_relaxed);
+    }
+};
+
+thread_local ThreadRing localRing;
+thread_local uint64_t localRequest = 0;
+
+Ring& threadRing() {
+    if (!localRing.ring) localRing.ring = registry().attach();
+    return *localRing.ring;
+}
+
+}  // namespace
+
+bool enabled() {
+    return tracing.load(std::memory_order_relaxed);
+}
+
+void setEnabled(bool on) {
+    tracing.store(on, std::memory_order_relaxed);
+}
+
+uint64_t currentRequest() {
+    return localRequest;
+}
+
+RequestScope::RequestScope(uint64_t requestId) : previous(localRequest) {
+    localRequest = requestId;
+}
+
+RequestScope::~RequestScope() {
+    localRequest = previous;
+}
+
+void record(const char* name, Clock::time_point start, Clock::time_point end, uint64_t requestId) {
+    if (!enabled()) return;
+    Ring& ring = threadRing();
+    uint64_t index = ring.head++;
+    Slot& slot = ring.slots[index % kSlots];
+    slot.seq.store(2 * index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.name.store(name, std::memory_order_relaxed);
+    slot.requestId.store(requestId, std::memory_order_relaxed);
+    slot.startNs.store(std::chrono::duration_cast<std::chrono::nanoseconds>(start - kEpoch).count(),
+                       std::memory_order_relaxed);
+    slot.durationNs.store(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count(),
+                          std::memory_order_relaxed);
+    slot.seq.store(2 * index + 2, std::memory_order_release);
+}
+
+std::vector<Event> collect() {
+    std::vector<Event> events;
+    for (const auto& ring : registry().all()) {
+        for (const Slot& slot : ring->slots) {
+            uint64_t before = slot.seq.load(std::memory_order_acquire);
+            if (before == 0 || (before & 1)) continue;
+            Event e;
+            e.name = slot.name.load(std::memory_order_relaxed);
+            e.requestId = slot.requestId.load(std::memory_order_relaxed);
+            e.startNs = slot.startNs.load(std::memory_order_relaxed);
+            e.durationNs = slot.durationNs.load(std::memory_order_relaxed);
+            e.thread = ring->thread;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.seq.load(std::memory_order_relaxed) != before) continue;
+            events.push_back(e);
+        }
+    }
+    return events;
+}
+
+void writeChromeJson(std::string& out, const std::vector<Event>& events) {
+    out += "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    char buf[256];
+    bool first = true;
+    for (const Event& e : events) {
+        int n = std::snprintf(buf, sizeof(buf),
+                              "%s{\"name\":\"%s\",\"cat\":\"lanchat\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+                              "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"rid\":%llu}}",
+                              first ? "" : ",", e.name, e.thread, static_cast<double>(e.startNs) / 1000.0,
+                              static_cast<double>(e.durationNs) / 1000.0,
+                              static_cast<unsigned long long>(e.requestId));
+        out.append(buf, static_cast<size_t>(n));
+        first = false;
+    }
+    out += "]}";
+}
+
+}  // namespace Trace
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Timing spans for recent requests, kept in memory for inspection. Each
+// thread writes completed spans into its own fixed-size ring, overwriting the
+// oldest; readers copy the rings without stopping the writers, skipping any
+// slot that is overwritten while being read.
+//
+//   Trace::RequestScope scope(rid);   // Spans below are tagged with rid
+//   { Trace::Span span("save"); ... }
+//
+// Names must be string literals; only the pointer is stored.
+namespace Trace {
+
+using Clock = std::chrono::steady_clock;
+
+bool enabled();
+void setEnabled(bool on);
+
+// Request the calling thread is working on, or 0
+uint64_t currentRequest();
+
+class RequestScope {
+public:
+    explicit RequestScope(uint64_t requestId);
+    ~RequestScope();
+    RequestScope(const RequestScope&) = delete;
+    RequestScope& operator=(const RequestScope&) = delete;
+
+private:
+    uint64_t previous;
+};
+
+void record(const char* name, Clock::time_point start, Clock::time_point end, uint64_t requestId);
+inline void record(const char* name, Clock::time_point start, Clock::time_point end) {
+    record(name, start, end, currentRequest());
+}
+
+// Records from construction to destruction, tagged with the current request
+class Span {
+public:
+    explicit Span(const char* name) : name(enabled() ? name : nullptr) {
+        if (this->name) start = Clock::now();
+    }
+    ~Span() {
+        if (name) record(name, start, Clock::now());
+    }
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+
+private:
+    const char* name;
+    Clock::time_point start;
+};
+
+struct Event {
+    const char* name;
+    uint64_t requestId;
+    int64_t startNs;  // Since startup
+    int64_t durationNs;
+    unsigned thread;
+};
+
+// Every span still held by a ring, in no particular order
+std::vector<Event> collect();
+
+// Chrome trace-event JSON ("X" complete events, microsecond timestamps),
+// loadable in chrome://tracing or Perfetto
+void writeChromeJson(std::string& out, const std::vector<Event>& events);
+
+}  // namespace Trace